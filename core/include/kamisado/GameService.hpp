@@ -20,18 +20,25 @@ public:
   void makeMove(Move move);
   void setEngineCallback(
       std::function<void(const SearchEngine::Result&)> callback);
+  void setEngineNetwork(std::shared_ptr<const nnue::Network> network);
+  void setEngineBook(std::shared_ptr<const OpeningBook> book);
+  auto saveEngineTable(const std::filesystem::path& path, int minDepth)
+      -> size_t;
+  auto loadEngineTable(const std::filesystem::path& path) -> size_t;
   void startEngineSearch();
   void stopEngine();
   void reset();
 
 private:
+  /// The engine and its table are only allocated once analysis is used
+  auto engine() -> SearchEngine&;
 
 private:
   int turn_{ 1 };
   GameState state_;
   Move lastMove_;
   std::vector<Move> availableMoves_;
-  SearchEngine engine_;
+  std::unique_ptr<SearchEngine> engine_;
   std::unordered_set<Coord, Coord::Hasher> canMoveFrom_;
 };
 
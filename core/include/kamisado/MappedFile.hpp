@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace kamisado {
+
+/// Read-only view of a whole file, memory mapped where the platform
+/// allows it. Throws std::system_error if the file cannot be opened.
+class MappedFile {
+public:
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)                    = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  [[nodiscard]] auto bytes() const -> std::span<const std::byte>;
+
+private:
+  const std::byte* data_{ nullptr };
+  size_t size_{ 0 };
+#ifdef _WIN32
+  std::vector<std::byte> buffer_;
+#endif
+};
+
+} // namespace kamisado
@@ -1,5 +1,6 @@
 #pragma once
 #include "kamisado/BoardProps.hpp"
+#include "kamisado/Config.hpp"
 #include <fmt/format.h>
 #include <ostream>
 
@@ -14,6 +15,25 @@ struct Move {
     return Move{ .from = where, .to = where, .isPass = true };
   }
 
+  /// Bits 0-5: from square, 6-11: to square, 12: pass
+  [[nodiscard]] constexpr auto encode() const -> uint16_t {
+    auto square = [](Coord c) {
+      return static_cast<unsigned>((c.row * config::BoardSize) + c.col);
+    };
+    return static_cast<uint16_t>(square(from) | (square(to) << 6U) |
+                                 (isPass ? 1U << 12U : 0U));
+  }
+
+  static constexpr auto decode(uint16_t bits) -> Move {
+    auto coord = [](unsigned square) {
+      return Coord{ square / config::BoardSize,
+                    square % config::BoardSize };
+    };
+    return Move{ .from   = coord(bits & 0x3FU),
+                 .to     = coord((bits >> 6U) & 0x3FU),
+                 .isPass = ((bits >> 12U) & 1U) != 0 };
+  }
+
   friend auto operator==(const Move& lhs, const Move& rhs)
       -> bool = default;
 
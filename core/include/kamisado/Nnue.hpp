@@ -0,0 +1,78 @@
+#pragma once
+#include "kamisado/Board.hpp"
+#include "kamisado/BoardProps.hpp"
+#include "kamisado/Config.hpp"
+#include "kamisado/GameState.hpp"
+#include "kamisado/Player.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace kamisado::nnue {
+
+// One input per (relative owner, tower color, relative square)
+constexpr size_t InputSize = static_cast<size_t>(Player::Count) *
+                             static_cast<size_t>(Color::Count) *
+                             config::BoardSize * config::BoardSize;
+constexpr size_t HiddenSize = 128;
+
+/// First layer outputs for both perspectives, kept up to date
+/// incrementally while the search walks the tree
+struct Accumulator {
+  alignas(32) std::array<std::array<int16_t, HiddenSize>,
+                         static_cast<size_t>(Player::Count)> values{};
+};
+
+struct NetworkLoadError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+/// Small efficiently updatable network:
+/// 1024 -> 2x128 (clipped ReLU) -> 1, int16 feature transformer and int8
+/// output layer. Features are seen from the evaluating side, black's
+/// view is the board rotated by 180 degrees.
+class Network {
+public:
+  /// Binary layout (little endian):
+  /// u32 magic, u32 version, u32 inputs, u32 hidden,
+  /// i16 ftBias[hidden], i16 ftWeights[inputs][hidden],
+  /// i8 outWeights[2 * hidden], i32 outBias[Color::Count + 1]
+  static auto load(const std::filesystem::path& path)
+      -> std::shared_ptr<const Network>;
+
+  void refresh(const Board& board, Accumulator& acc) const;
+
+  void update(const Accumulator& parent, Tower tower, Coord from,
+              Coord to, Accumulator& child) const;
+
+  [[nodiscard]] auto evaluate(const Accumulator& acc, const GameState& s,
+                              Player perspective) const -> int;
+
+  static constexpr uint32_t s_Magic{ 0x45554E4B }; // "KNUE"
+  static constexpr uint32_t s_Version{ 1 };
+
+private:
+  Network() = default;
+
+  [[nodiscard]] auto featureWeights(Player perspective, Tower tower,
+                                    Coord pos) const -> const int16_t*;
+
+private:
+  // Activation and output weight quantization
+  static constexpr int s_QA{ 127 };
+  static constexpr int s_QB{ 64 };
+  static constexpr int s_OutputScale{ 400 };
+
+  std::vector<int16_t> ftBias_;
+  std::vector<int16_t> ftWeights_;
+  std::vector<int8_t> outWeights_;
+  // Indexed by forced color of the side to move (Count = none)
+  std::array<int32_t, static_cast<size_t>(Color::Count) + 1ULL>
+      outBias_{};
+};
+
+} // namespace kamisado::nnue
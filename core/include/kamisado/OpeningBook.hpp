@@ -0,0 +1,66 @@
+#pragma once
+#include "kamisado/MappedFile.hpp"
+#include "kamisado/Move.hpp"
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace kamisado {
+
+struct BookError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+/// Precomputed search results keyed by GameState::hash(), stored sorted
+/// and memory mapped so lookups are a binary search over the file
+class OpeningBook {
+public:
+  struct Entry {
+    uint64_t key{ 0 };
+    int32_t score{ 0 };
+    uint16_t move{ 0 };
+    uint16_t depth{ 0 };
+  };
+  static_assert(sizeof(Entry) == 16 && "Entry is the on-disk layout");
+  static_assert(std::endian::native == std::endian::little &&
+                "Book files are little endian");
+
+  struct Hit {
+    Move move;
+    int score{ 0 };
+    int depth{ 0 };
+  };
+
+  /// Throws BookError if the file is missing or malformed
+  static auto open(const std::filesystem::path& path)
+      -> std::shared_ptr<const OpeningBook>;
+
+  /// Sorts entries by key and writes them in the mapped layout
+  static void write(const std::filesystem::path& path,
+                    std::vector<Entry> entries);
+
+  [[nodiscard]] auto probe(uint64_t key) const -> std::optional<Hit>;
+  [[nodiscard]] auto size() const -> size_t;
+
+  static constexpr uint32_t s_Magic{ 0x314B424B }; // "KBK1"
+  static constexpr uint32_t s_Version{ 1 };
+
+private:
+  explicit OpeningBook(const std::filesystem::path& path);
+
+  struct Header {
+    uint32_t magic{ s_Magic };
+    uint32_t version{ s_Version };
+    uint64_t count{ 0 };
+  };
+
+  MappedFile file_;
+  std::span<const Entry> entries_;
+};
+
+} // namespace kamisado
@@ -3,13 +3,21 @@
 #include "kamisado/GameState.hpp"
 #include "kamisado/Move.hpp"
 #include "kamisado/MoveGen.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
 #include "kamisado/Player.hpp"
+#include "kamisado/TranspositionTable.hpp"
 #include <array>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <stdexcept>
+#include <stop_token>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -17,35 +25,62 @@
 namespace kamisado {
 
 class SearchEngine {
-  enum class Bound : uint8_t {
-    Exact,
-    Lower,
-    Upper
-  };
-
-  struct TTEntry {
-    uint64_t key{ 0 };
-    int depthRemaining{ 0 };
-    int score{ 0 };
-    Bound bound{ Bound::Exact };
-    Move bestMove{};
-    bool hasBest{ false };
-  };
+  using Bound   = TranspositionTable::Bound;
+  using TTEntry = TranspositionTable::Entry;
 
 public:
   struct Result {
     std::optional<Move> bestMove;
     int score{ 0 };
+    int depth{ 0 };
+  };
+
+  /// Zero node/time budgets mean unlimited. Budgets never cut depth 1,
+  /// so a search always yields a move
+  struct Limits {
+    int maxDepth{ config::MaxDepth };
+    uint64_t maxNodes{ 0 };
+    std::chrono::milliseconds maxTime{ 0 };
+    /// Stops like stopSearch(), but is not cleared when search() starts,
+    /// so a request racing the start is not lost
+    std::stop_token stop{};
   };
 
   explicit SearchEngine(size_t ttSizePow2 = 1U << 20U);
+  /// Shares the table with other engines, which may search concurrently
+  explicit SearchEngine(std::shared_ptr<TranspositionTable> table);
   ~SearchEngine();
 
   void reset();
   [[nodiscard]] auto nodes() const -> uint64_t;
+  /// Table lookups and hits since the last reset()
+  [[nodiscard]] auto tableProbes() const -> uint64_t;
+  [[nodiscard]] auto tableHits() const -> uint64_t;
 
   void setCallback(std::function<void(const Result&)> callback);
+  /// Evaluate leaves with the given network, nullptr selects the
+  /// handcrafted Evaluator
+  void setNetwork(std::shared_ptr<const nnue::Network> network);
+  /// Positions found in the book are answered without searching
+  void setBook(std::shared_ptr<const OpeningBook> book);
   void startSearch(const GameState& s, int maxDepth);
+  void startSearch(const GameState& s, Limits limits);
+  /// Blocking search on the calling thread
+  auto search(const GameState& s, Limits limits) -> Result;
+  /// Like search(), but iterative deepening resumes above a result
+  /// already known for s. Returns known if no deeper iteration completes
+  auto search(const GameState& s, Limits limits, const Result& known)
+      -> Result;
+  /// Forget all transpositions, e.g. between independent games. This
+  /// also clears them for engines sharing the table
+  void clearTable();
+  /// Writes entries searched at least minDepth plies deep to a
+  /// versioned file, returns the number written
+  auto saveTable(const std::filesystem::path& path, int minDepth = 0)
+      -> size_t;
+  /// Merges a snapshot into the table. Throws SnapshotError on a
+  /// missing, corrupt or incompatible file
+  auto loadTable(const std::filesystem::path& path) -> size_t;
 
   void stopSearch();
 
@@ -53,7 +88,8 @@ public:
   [[nodiscard]] auto currentBest() const -> std::optional<Result>;
 
 private:
-  auto probe(uint64_t key) -> TTEntry*;
+  [[nodiscard]] auto tableKey(const GameState& s) const -> uint64_t;
+  [[nodiscard]] auto probe(uint64_t key) const -> std::optional<TTEntry>;
 
   void store(uint64_t key, int depthRemainig, int score, Bound bound,
              std::optional<Move> bestMove);
@@ -71,21 +107,41 @@ private:
                    Player perspective, int depth, int alpha, int beta,
                    int ply) -> Result;
 
+  auto probeBook(const GameState& s) -> bool;
+  void iterativeDeepening(const GameState& s, int fromDepth = 1);
+  auto stopped() -> bool;
+
+  auto evaluate(const GameState& s, int ply, Player perspective) -> int;
+  void updateAccumulator(const GameState& parent, const Move& move,
+                         int ply);
+
 private:
+  // Keeps NNUE and handcrafted scores apart in a shared table
+  static constexpr uint64_t s_NetworkKeySalt{ 0x9E3779B97F4A7C15ULL };
+
   static constexpr int s_Inf{ std::numeric_limits<int>::max() / 1000 *
                               1000 };
 
-  std::vector<TTEntry> tt_;
+  std::shared_ptr<TranspositionTable> tt_;
   uint64_t nodes_{ 0 };
+  mutable uint64_t tableProbes_{ 0 };
+  mutable uint64_t tableHits_{ 0 };
   int depth_{ 0 };
-  int targeDepth_{ 0 };
+  Limits limits_;
+  std::chrono::steady_clock::time_point deadline_;
+  bool outOfBudget_{ false };
   std::function<void(const Result&)> resultCallback_{ [](auto&&) {
   } };
   std::optional<Result> currentBest_;
   std::array<std::array<std::optional<Move>, 2>, 128> killers_;
   std::optional<Move> pv_;
+  std::shared_ptr<const nnue::Network> network_;
+  std::shared_ptr<const OpeningBook> book_;
+  // Indexed by ply, child entries are derived from the parent's
+  std::vector<nnue::Accumulator> accumulators_;
   std::thread searchThread_;
   std::atomic<bool> running_{ false };
+  std::atomic<bool> finished_{ false };
 };
 
 } // namespace kamisado
@@ -0,0 +1,95 @@
+#pragma once
+#include "kamisado/Move.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace kamisado {
+
+struct SnapshotError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+/// Search results keyed by position hash. Slots are two atomic words
+/// holding the key xor-ed with the packed data, so engines on several
+/// threads can share one table: a torn write reads back as a miss
+class TranspositionTable {
+public:
+  enum class Bound : uint8_t {
+    Exact,
+    Lower,
+    Upper
+  };
+
+  struct Entry {
+    uint64_t key{ 0 };
+    int depthRemaining{ 0 };
+    int score{ 0 };
+    Bound bound{ Bound::Exact };
+    Move bestMove{};
+    bool hasBest{ false };
+  };
+
+  static constexpr size_t s_SlotBytes{ 16 };
+
+  explicit TranspositionTable(size_t sizePow2);
+
+  /// Largest power of 2 slot count that fits in the given bytes
+  static auto sizeForBytes(size_t bytes) -> size_t;
+
+  [[nodiscard]] auto size() const -> size_t;
+  [[nodiscard]] auto probe(uint64_t key) const -> std::optional<Entry>;
+  /// Keeps the deeper of the new and the existing entry
+  void store(const Entry& entry);
+  void clear();
+
+  /// Writes entries searched at least minDepth plies deep to a
+  /// versioned file, returns the number written
+  auto save(const std::filesystem::path& path, int minDepth = 0) const
+      -> size_t;
+  /// Merges a snapshot into the table. Throws SnapshotError on a
+  /// missing, corrupt or incompatible file
+  auto load(const std::filesystem::path& path) -> size_t;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> check{ 0 };
+    std::atomic<uint64_t> data{ 0 };
+  };
+  static_assert(sizeof(Slot) == s_SlotBytes);
+
+  // Same field layout as a packed data word
+  struct SnapshotEntry {
+    uint64_t key{ 0 };
+    int32_t score{ 0 };
+    uint16_t move{ 0 };
+    uint8_t depthRemaining{ 0 };
+    uint8_t flags{ 0 }; // bits 0-1: bound, bit 2: hasBest
+  };
+  static_assert(sizeof(SnapshotEntry) == 16 &&
+                "SnapshotEntry is the on-disk layout");
+
+  struct SnapshotHeader {
+    uint32_t magic{ s_SnapshotMagic };
+    uint32_t version{ s_SnapshotVersion };
+    uint64_t count{ 0 };
+    uint64_t checksum{ 0 };
+  };
+
+  static constexpr uint32_t s_SnapshotMagic{ 0x3154544B }; // "KTT1"
+  static constexpr uint32_t s_SnapshotVersion{ 1 };
+
+  static auto pack(const Entry& entry) -> uint64_t;
+  static auto unpack(uint64_t key, uint64_t data) -> Entry;
+  [[nodiscard]] auto slot(uint64_t key) const -> const Slot&;
+  auto slot(uint64_t key) -> Slot&;
+
+private:
+  std::vector<Slot> slots_;
+};
+
+} // namespace kamisado
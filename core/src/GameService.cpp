@@ -8,7 +8,14 @@ GameService::GameService()
 }
 
 GameService::~GameService() {
-  engine_.stopSearch();
+  stopEngine();
+}
+
+auto GameService::engine() -> SearchEngine& {
+  if (!engine_) {
+    engine_ = std::make_unique<SearchEngine>();
+  }
+  return *engine_;
 }
 
 auto GameService::state() const -> const GameState& {
@@ -38,9 +45,11 @@ auto GameService::canMoveFrom(const Coord& coord) const -> bool {
 void GameService::reset() {
   state_ = GameState{ Board{ BoardColoring::official() } };
   turn_  = 1;
-  engine_.stopSearch();
-  engine_.setCallback([](auto&&) {
-  });
+  if (engine_) {
+    engine_->stopSearch();
+    engine_->setCallback([](auto&&) {
+    });
+  }
   availableMoves_ = MoveGen::legalMoves(state_);
   canMoveFrom_.clear();
   for (auto&& move : availableMoves_) {
@@ -50,7 +59,7 @@ void GameService::reset() {
 
 void GameService::makeMove(Move move) {
   state_ = state_.apply(move);
-  engine_.stopSearch();
+  stopEngine();
   lastMove_ = move;
   turn_++;
   availableMoves_ = MoveGen::legalMoves(state_);
@@ -66,15 +75,36 @@ auto GameService::lastMove() const -> std::optional<Move> {
 
 void GameService::setEngineCallback(
     std::function<void(const SearchEngine::Result&)> callback) {
-  engine_.setCallback(std::move(callback));
+  engine().setCallback(std::move(callback));
+}
+
+void GameService::setEngineNetwork(
+    std::shared_ptr<const nnue::Network> network) {
+  engine().setNetwork(std::move(network));
+}
+
+void GameService::setEngineBook(std::shared_ptr<const OpeningBook> book) {
+  engine().setBook(std::move(book));
+}
+
+auto GameService::saveEngineTable(const std::filesystem::path& path,
+                                  int minDepth) -> size_t {
+  return engine().saveTable(path, minDepth);
+}
+
+auto GameService::loadEngineTable(const std::filesystem::path& path)
+    -> size_t {
+  return engine().loadTable(path);
 }
 
 void GameService::startEngineSearch() {
-  engine_.startSearch(state_, config::MaxDepth);
+  engine().startSearch(state_, config::MaxDepth);
 }
 
 void GameService::stopEngine() {
-  engine_.stopSearch();
+  if (engine_) {
+    engine_->stopSearch();
+  }
 }
 
 } // namespace kamisado
@@ -0,0 +1,75 @@
+#include "kamisado/MappedFile.hpp"
+#include <cerrno>
+#include <system_error>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kamisado {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  std::ifstream in{ path, std::ios::binary };
+  if (!in) {
+    throw std::system_error(std::make_error_code(std::errc::io_error),
+                            path.string());
+  }
+  buffer_.resize(std::filesystem::file_size(path));
+  in.read(reinterpret_cast<char*>(buffer_.data()), // NOLINT
+          static_cast<std::streamsize>(buffer_.size()));
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd{ ::open(path.c_str(), O_RDONLY) }; // NOLINT
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            path.string());
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    const int err{ errno };
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), path.string());
+  }
+
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ > 0) {
+    void* addr{ ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) };
+    if (addr == MAP_FAILED) { // NOLINT
+      const int err{ errno };
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(),
+                              path.string());
+    }
+    data_ = static_cast<const std::byte*>(addr);
+  }
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<std::byte*>(data_), size_); // NOLINT
+  }
+}
+
+#endif
+
+auto MappedFile::bytes() const -> std::span<const std::byte> {
+  return { data_, size_ };
+}
+
+} // namespace kamisado
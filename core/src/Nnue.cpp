@@ -0,0 +1,203 @@
+#include "kamisado/Nnue.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace kamisado::nnue {
+
+namespace {
+
+template <typename T>
+void readExact(std::ifstream& in, T* data, size_t count,
+               const std::filesystem::path& path) {
+  in.read(reinterpret_cast<char*>(data), // NOLINT
+          static_cast<std::streamsize>(count * sizeof(T)));
+  if (!in) {
+    throw NetworkLoadError(
+        fmt::format("Truncated network file: {}", path.string()));
+  }
+}
+
+/// dst = src - sub + add
+void moveFeature(int16_t* dst, const int16_t* src, const int16_t* sub,
+                 const int16_t* add) {
+#if defined(__AVX2__)
+  for (size_t i = 0; i < HiddenSize; i += 16) {
+    // NOLINTBEGIN
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + i));
+    v = _mm256_sub_epi16(
+        v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sub + i)));
+    v = _mm256_add_epi16(
+        v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(add + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    // NOLINTEND
+  }
+#else
+  for (size_t i = 0; i < HiddenSize; i++) {
+    dst[i] = static_cast<int16_t>(src[i] - sub[i] + add[i]);
+  }
+#endif
+}
+
+void addFeature(int16_t* acc, const int16_t* add) {
+#if defined(__AVX2__)
+  for (size_t i = 0; i < HiddenSize; i += 16) {
+    // NOLINTBEGIN
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(acc + i));
+    v = _mm256_add_epi16(
+        v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(add + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), v);
+    // NOLINTEND
+  }
+#else
+  for (size_t i = 0; i < HiddenSize; i++) {
+    acc[i] = static_cast<int16_t>(acc[i] + add[i]);
+  }
+#endif
+}
+
+/// sum(clamp(acc, 0, qa) * w)
+auto clippedDot(const int16_t* acc, const int8_t* w, int qa) -> int32_t {
+#if defined(__AVX2__)
+  // NOLINTBEGIN
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i max  = _mm256_set1_epi16(static_cast<int16_t>(qa));
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum        = _mm256_setzero_si256();
+  for (size_t i = 0; i < HiddenSize; i += 32) {
+    __m256i a0 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(acc + i));
+    __m256i a1 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(acc + i + 16));
+    a0 = _mm256_min_epi16(_mm256_max_epi16(a0, zero), max);
+    a1 = _mm256_min_epi16(_mm256_max_epi16(a1, zero), max);
+    // packus interleaves 128-bit lanes, restore element order
+    const __m256i activations =
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(a0, a1), 0xD8);
+    const __m256i weights =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+    const __m256i products = _mm256_maddubs_epi16(activations, weights);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                            _mm256_extracti128_si256(sum, 1));
+  s         = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+  s         = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+  return _mm_cvtsi128_si32(s);
+  // NOLINTEND
+#else
+  int32_t sum{ 0 };
+  for (size_t i = 0; i < HiddenSize; i++) {
+    sum += std::clamp<int32_t>(acc[i], 0, qa) * w[i];
+  }
+  return sum;
+#endif
+}
+
+} // namespace
+
+auto Network::load(const std::filesystem::path& path)
+    -> std::shared_ptr<const Network> {
+  std::ifstream in{ path, std::ios::binary };
+  if (!in) {
+    throw NetworkLoadError(
+        fmt::format("Could not open network file: {}", path.string()));
+  }
+
+  std::array<uint32_t, 4> header{};
+  readExact(in, header.data(), header.size(), path);
+  auto [magic, version, inputs, hidden] = header;
+  if (magic != s_Magic) {
+    throw NetworkLoadError(
+        fmt::format("Not a network file: {}", path.string()));
+  }
+  if (version != s_Version || inputs != InputSize ||
+      hidden != HiddenSize) {
+    throw NetworkLoadError(fmt::format(
+        "Unsupported network {}: version {}, {}x{} (expected {}, {}x{})",
+        path.string(), version, inputs, hidden, s_Version, InputSize,
+        HiddenSize));
+  }
+
+  std::shared_ptr<Network> net{ new Network };
+  net->ftBias_.resize(HiddenSize);
+  net->ftWeights_.resize(InputSize * HiddenSize);
+  net->outWeights_.resize(static_cast<size_t>(Player::Count) *
+                          HiddenSize);
+  readExact(in, net->ftBias_.data(), net->ftBias_.size(), path);
+  readExact(in, net->ftWeights_.data(), net->ftWeights_.size(), path);
+  readExact(in, net->outWeights_.data(), net->outWeights_.size(), path);
+  readExact(in, net->outBias_.data(), net->outBias_.size(), path);
+  return net;
+}
+
+auto Network::featureWeights(Player perspective, Tower tower,
+                             Coord pos) const -> const int16_t* {
+  constexpr auto last{ static_cast<Coord::T>(config::BoardSize - 1) };
+  if (perspective == Player::Black) {
+    pos = Coord{ last - pos.row, last - pos.col };
+  }
+  const size_t relOwner{ tower.owner == perspective ? 0U : 1U };
+  const size_t square{ (pos.row * config::BoardSize) + pos.col };
+  const size_t feature{
+    (((relOwner * static_cast<size_t>(Color::Count)) +
+      static_cast<size_t>(tower.color)) *
+     config::BoardSize * config::BoardSize) +
+    square
+  };
+  return &ftWeights_[feature * HiddenSize];
+}
+
+void Network::refresh(const Board& board, Accumulator& acc) const {
+  for (size_t p = 0; p < static_cast<size_t>(Player::Count); p++) {
+    const Player perspective{ static_cast<Player>(p) };
+    auto& values{ acc.values[p] };
+    std::ranges::copy(ftBias_, values.begin());
+
+    for (size_t o = 0; o < static_cast<size_t>(Player::Count); o++) {
+      for (size_t c = 0; c < static_cast<size_t>(Color::Count); c++) {
+        const Tower tower{ .owner = static_cast<Player>(o),
+                           .color = static_cast<Color>(c) };
+        const Coord pos{ board.towerPos(tower.owner, tower.color) };
+        addFeature(values.data(), featureWeights(perspective, tower, pos));
+      }
+    }
+  }
+}
+
+void Network::update(const Accumulator& parent, Tower tower, Coord from,
+                     Coord to, Accumulator& child) const {
+  for (size_t p = 0; p < static_cast<size_t>(Player::Count); p++) {
+    const Player perspective{ static_cast<Player>(p) };
+    moveFeature(child.values[p].data(), parent.values[p].data(),
+                featureWeights(perspective, tower, from),
+                featureWeights(perspective, tower, to));
+  }
+}
+
+auto Network::evaluate(const Accumulator& acc, const GameState& s,
+                       Player perspective) const -> int {
+  const auto& us{ acc.values[static_cast<size_t>(perspective)] };
+  const auto& them{ acc.values[static_cast<size_t>(opposite(perspective))] };
+
+  int32_t sum{ clippedDot(us.data(), outWeights_.data(), s_QA) +
+               clippedDot(them.data(), outWeights_.data() + HiddenSize,
+                          s_QA) };
+
+  // Forced color only constrains the side to move
+  const auto forced{ s.playerToMove() == perspective
+                         ? s.forcedColor().value_or(Color::Count)
+                         : Color::Count };
+  sum += outBias_[static_cast<size_t>(forced)];
+
+  return static_cast<int>(static_cast<int64_t>(sum) * s_OutputScale /
+                          (s_QA * s_QB));
+}
+
+} // namespace kamisado::nnue
@@ -0,0 +1,89 @@
+#include "kamisado/OpeningBook.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <system_error>
+
+namespace kamisado {
+
+OpeningBook::OpeningBook(const std::filesystem::path& path)
+    : file_{ path } {
+  auto bytes{ file_.bytes() };
+  Header header;
+  if (bytes.size() < sizeof(Header)) {
+    throw BookError(fmt::format("Truncated book: {}", path.string()));
+  }
+  std::memcpy(&header, bytes.data(), sizeof(Header));
+  if (header.magic != s_Magic || header.version != s_Version) {
+    throw BookError(
+        fmt::format("Unsupported book format: {}", path.string()));
+  }
+  if (bytes.size() != sizeof(Header) + (header.count * sizeof(Entry))) {
+    throw BookError(
+        fmt::format("Book size mismatch: {}", path.string()));
+  }
+
+  entries_ = { reinterpret_cast<const Entry*>( // NOLINT
+                   bytes.data() + sizeof(Header)),
+               header.count };
+  assert(std::ranges::is_sorted(entries_, {}, &Entry::key) &&
+         "Book is not sorted");
+}
+
+auto OpeningBook::open(const std::filesystem::path& path)
+    -> std::shared_ptr<const OpeningBook> {
+  try {
+    return std::shared_ptr<const OpeningBook>{ new OpeningBook{ path } };
+  } catch (const std::system_error& e) {
+    throw BookError(e.what());
+  }
+}
+
+void OpeningBook::write(const std::filesystem::path& path,
+                        std::vector<Entry> entries) {
+  std::ranges::sort(entries, {}, &Entry::key);
+  auto dup{ std::ranges::unique(entries, {}, &Entry::key) };
+  entries.erase(dup.begin(), dup.end());
+
+  // Readers map the book, rewriting it in place would fault them, and
+  // a crash would leave it torn
+  auto tmpPath{ path };
+  tmpPath += ".tmp";
+  {
+    std::ofstream out{ tmpPath, std::ios::binary | std::ios::trunc };
+    const Header header{ .count = entries.size() };
+    out.write(reinterpret_cast<const char*>(&header), // NOLINT
+              sizeof(header));
+    out.write(
+        reinterpret_cast<const char*>(entries.data()), // NOLINT
+        static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+    out.flush();
+    if (!out) {
+      throw BookError(
+          fmt::format("Could not write {}", tmpPath.string()));
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    throw BookError(fmt::format("Could not replace {}: {}", path.string(),
+                                ec.message()));
+  }
+}
+
+auto OpeningBook::probe(uint64_t key) const -> std::optional<Hit> {
+  auto it{ std::ranges::lower_bound(entries_, key, {}, &Entry::key) };
+  if (it == entries_.end() || it->key != key) {
+    return std::nullopt;
+  }
+  return Hit{ .move  = Move::decode(it->move),
+              .score = it->score,
+              .depth = it->depth };
+}
+
+auto OpeningBook::size() const -> size_t {
+  return entries_.size();
+}
+
+} // namespace kamisado
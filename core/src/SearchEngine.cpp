@@ -9,35 +9,36 @@
 namespace kamisado {
 
 SearchEngine::SearchEngine(size_t ttSizePow2)
-    : tt_(ttSizePow2) {
-  assert((ttSizePow2 & (ttSizePow2 - 1U)) == 0 &&
-         "ttSizePow2 must be a power of 2");
+    : tt_{ std::make_shared<TranspositionTable>(ttSizePow2) } {}
+
+SearchEngine::SearchEngine(std::shared_ptr<TranspositionTable> table)
+    : tt_{ std::move(table) } {
+  assert(tt_ && "Table must not be null");
 }
 
 SearchEngine::~SearchEngine() {
   stopSearch();
 }
 
-auto SearchEngine::probe(uint64_t key) -> TTEntry* {
-  TTEntry& e = tt_[key & (tt_.size() - 1)];
-  if (e.key == key) {
-    return &e;
-  }
-  return nullptr;
+auto SearchEngine::tableKey(const GameState& s) const -> uint64_t {
+  return s.hash() ^ (network_ ? s_NetworkKeySalt : 0);
+}
+
+auto SearchEngine::probe(uint64_t key) const -> std::optional<TTEntry> {
+  auto entry = tt_->probe(key);
+  ++tableProbes_;
+  tableHits_ += entry ? 1 : 0;
+  return entry;
 }
 
 void SearchEngine::store(uint64_t key, int depthRemainig, int score,
                          Bound bound, std::optional<Move> bestMove) {
-  TTEntry& e = tt_[key & (tt_.size() - 1)];
-
-  if (e.key == 0 || depthRemainig >= e.depthRemaining) {
-    e.key            = key;
-    e.depthRemaining = depthRemainig;
-    e.score          = score;
-    e.bound          = bound;
-    e.bestMove       = bestMove.value_or(Move{});
-    e.hasBest        = bestMove.has_value();
-  }
+  tt_->store(TTEntry{ .key            = key,
+                      .depthRemaining = depthRemainig,
+                      .score          = score,
+                      .bound          = bound,
+                      .bestMove       = bestMove.value_or(Move{}),
+                      .hasBest        = bestMove.has_value() });
 }
 
 auto SearchEngine::moveOrderingScore(const GameState& s, const Move& move)
@@ -77,7 +78,7 @@ auto SearchEngine::searchRoot(const GameState& s, int depth, int alpha,
   }
 
   bool firstGood{ false };
-  auto* tte{ probe(s.hash()) };
+  auto tte{ probe(tableKey(s)) };
   if (tte && tte->hasBest) {
     auto it{ std::ranges::find_if(moves, [&](const auto& m) {
       return m == tte->bestMove;
@@ -105,6 +106,13 @@ auto SearchEngine::searchRoot(const GameState& s, int depth, int alpha,
 
   const Player perspective{ s.playerToMove() };
 
+  if (network_) {
+    if (accumulators_.empty()) {
+      accumulators_.resize(2);
+    }
+    network_->refresh(s.board(), accumulators_[1]);
+  }
+
   Result result{ negamaxLoop(s, moves, perspective, depth, alpha, beta,
                              1) };
 
@@ -122,11 +130,11 @@ auto SearchEngine::alphaBeta(const GameState& s, int depth, int alpha,
     return Evaluator::mateScore(status.winner == perspective, ply);
   }
 
-  if (depth <= 0 || !running_) {
-    return Evaluator::evaluate(s, perspective);
+  if (depth <= 0 || stopped()) {
+    return evaluate(s, ply, perspective);
   }
 
-  auto* tte{ probe(s.hash()) };
+  auto tte{ probe(tableKey(s)) };
   if (tte && tte->depthRemaining >= depth) {
     if (tte->bound == Bound::Exact) {
       return tte->score;
@@ -179,6 +187,11 @@ auto SearchEngine::alphaBeta(const GameState& s, int depth, int alpha,
 
   Result result{ negamaxLoop(s, moves, perspective, depth, alpha, beta,
                              ply) };
+  // A cut-off subtree scored from static evaluations, storing it at
+  // full depth would poison later probes and other users of the table
+  if (stopped()) {
+    return result.score;
+  }
 
   Bound bound{ Bound::Exact };
   if (result.score <= alpha) {
@@ -186,20 +199,52 @@ auto SearchEngine::alphaBeta(const GameState& s, int depth, int alpha,
   } else if (result.score >= beta) {
     bound = Bound::Lower;
   }
-  store(s.hash(), depth, result.score, bound, result.bestMove);
+  store(tableKey(s), depth, result.score, bound, result.bestMove);
   return result.score;
 }
 
 void SearchEngine::reset() {
   stopSearch();
-  nodes_ = 0;
+  nodes_       = 0;
+  tableProbes_ = 0;
+  tableHits_   = 0;
   currentBest_.reset();
-  depth_ = 0;
+  depth_       = 0;
+  outOfBudget_ = false;
+  finished_    = false;
 }
+
+void SearchEngine::clearTable() {
+  stopSearch();
+  tt_->clear();
+  killers_ = {};
+  pv_.reset();
+}
+
+auto SearchEngine::saveTable(const std::filesystem::path& path,
+                             int minDepth) -> size_t {
+  stopSearch();
+  return tt_->save(path, minDepth);
+}
+
+auto SearchEngine::loadTable(const std::filesystem::path& path)
+    -> size_t {
+  stopSearch();
+  return tt_->load(path);
+}
+
 auto SearchEngine::nodes() const -> uint64_t {
   return nodes_;
 }
 
+auto SearchEngine::tableProbes() const -> uint64_t {
+  return tableProbes_;
+}
+
+auto SearchEngine::tableHits() const -> uint64_t {
+  return tableHits_;
+}
+
 auto SearchEngine::negamaxLoop(const GameState& s,
                                const std::vector<Move>& moves,
                                Player perspective, int depth, int alpha,
@@ -210,6 +255,9 @@ auto SearchEngine::negamaxLoop(const GameState& s,
   for (auto&& move : moves) {
 
     GameState child{ s.apply(move) };
+    if (network_) {
+      updateAccumulator(s, move, ply);
+    }
 
     int extDepth{ 0 };
     assert(child.forcedColor() && "Move 2+ should have forced color");
@@ -231,6 +279,9 @@ auto SearchEngine::negamaxLoop(const GameState& s,
                            ply + 1, opposite(perspective));
       }
     }
+    if (stopped()) {
+      break;
+    }
 
     if (score > bestScore) {
       bestScore = score;
@@ -256,56 +307,162 @@ auto SearchEngine::negamaxLoop(const GameState& s,
   };
 }
 
+auto SearchEngine::evaluate(const GameState& s, int ply,
+                            Player perspective) -> int {
+  if (!network_) {
+    return Evaluator::evaluate(s, perspective);
+  }
+  return Evaluator::clampNonMateScore(network_->evaluate(
+      accumulators_[static_cast<size_t>(ply)], s, perspective));
+}
+
+void SearchEngine::updateAccumulator(const GameState& parent,
+                                     const Move& move, int ply) {
+  const auto next{ static_cast<size_t>(ply) + 1 };
+  if (accumulators_.size() <= next) {
+    accumulators_.resize(next + 1);
+  }
+
+  if (move.isPass) {
+    accumulators_[next] = accumulators_[next - 1];
+    return;
+  }
+
+  assert(parent.board().towerAt(move.from).has_value() &&
+         "No tower to move");
+  network_->update(accumulators_[next - 1],
+                   *parent.board().towerAt(move.from), move.from,
+                   move.to, accumulators_[next]);
+}
+
 void SearchEngine::startSearch(const GameState& s, int maxDepth) {
+  startSearch(s, Limits{ .maxDepth = maxDepth });
+}
+
+void SearchEngine::startSearch(const GameState& s, Limits limits) {
   reset();
-  targeDepth_   = maxDepth;
+  if (probeBook(s)) {
+    finished_ = true;
+    return;
+  }
+  limits_       = limits;
+  deadline_     = std::chrono::steady_clock::now() + limits.maxTime;
   running_      = true;
   searchThread_ = std::thread([this, s]() {
-    for (depth_ = 1; depth_ <= targeDepth_ && running_; depth_++) {
-      int window{ 50 };
-      int alpha{ -s_Inf };
-      int beta{ s_Inf };
-      if (depth_ > 1) {
-        alpha = currentBest_->score - window;
-        beta  = currentBest_->score + window;
-      }
-      std::optional<Move> pvHint{ currentBest_.has_value()
-                                      ? currentBest_->bestMove
-                                      : std::nullopt };
+    iterativeDeepening(s);
+    finished_ = true;
+  });
+}
 
-      auto r{ searchRoot(s, depth_, alpha, beta, pvHint) };
+auto SearchEngine::search(const GameState& s, Limits limits) -> Result {
+  reset();
+  if (probeBook(s)) {
+    return *currentBest_;
+  }
+  limits_   = limits;
+  deadline_ = std::chrono::steady_clock::now() + limits.maxTime;
+  running_  = true;
+  iterativeDeepening(s);
+  running_ = false;
+  return currentBest_.value_or(Result{});
+}
 
-      if (r.score <= alpha || r.score >= beta) {
-        r = searchRoot(s, depth_, -s_Inf, s_Inf, pvHint);
-      }
+auto SearchEngine::search(const GameState& s, Limits limits,
+                          const Result& known) -> Result {
+  reset();
+  limits_      = limits;
+  deadline_    = std::chrono::steady_clock::now() + limits.maxTime;
+  running_     = true;
+  currentBest_ = known;
+  // Seeds the aspiration window and move ordering of the next depth
+  iterativeDeepening(s, known.depth + 1);
+  running_ = false;
+  return *currentBest_;
+}
 
-      if (r.bestMove && running_) {
-        currentBest_ = r;
-        resultCallback_(r);
-        // std::cout << fmt::format("Depth: {}; bestScore: {}; move:
-        // {}\n",
-        //                          depth_,
-        //                          Evaluator::formatScore(r.score),
-        //                          r.bestMove.value_or({}));
-      } else {
-        break;
-      }
+auto SearchEngine::probeBook(const GameState& s) -> bool {
+  if (!book_) {
+    return false;
+  }
+  auto hit{ book_->probe(s.hash()) };
+  if (!hit) {
+    return false;
+  }
 
-      if (Evaluator::isMateScore(r.score)) {
-        break;
-      }
+  // Guard against key collisions
+  auto moves{ MoveGen::legalMoves(s) };
+  if (std::ranges::find(moves, hit->move) == moves.end()) {
+    return false;
+  }
+
+  currentBest_ = Result{ .bestMove = hit->move,
+                         .score    = hit->score,
+                         .depth    = hit->depth };
+  resultCallback_(*currentBest_);
+  return true;
+}
+
+void SearchEngine::iterativeDeepening(const GameState& s, int fromDepth) {
+  for (depth_ = fromDepth; depth_ <= limits_.maxDepth && !stopped();
+       depth_++) {
+    int window{ 50 };
+    int alpha{ -s_Inf };
+    int beta{ s_Inf };
+    if (depth_ > 1) {
+      alpha = currentBest_->score - window;
+      beta  = currentBest_->score + window;
     }
-  });
+    std::optional<Move> pvHint{ currentBest_.has_value()
+                                    ? currentBest_->bestMove
+                                    : std::nullopt };
+
+    auto r{ searchRoot(s, depth_, alpha, beta, pvHint) };
+
+    if (r.score <= alpha || r.score >= beta) {
+      r = searchRoot(s, depth_, -s_Inf, s_Inf, pvHint);
+    }
+
+    if (r.bestMove && !stopped()) {
+      r.depth      = depth_;
+      currentBest_ = r;
+      resultCallback_(r);
+    } else {
+      break;
+    }
+
+    if (Evaluator::isMateScore(r.score)) {
+      break;
+    }
+  }
+}
+
+auto SearchEngine::stopped() -> bool {
+  if (!running_ || limits_.stop.stop_requested()) {
+    return true;
+  }
+  if (outOfBudget_ || depth_ <= 1) {
+    return outOfBudget_;
+  }
+
+  constexpr uint64_t timeCheckInterval{ 1024 };
+  if (limits_.maxNodes != 0 && nodes_ >= limits_.maxNodes) {
+    outOfBudget_ = true;
+  } else if (limits_.maxTime.count() != 0 &&
+             nodes_ % timeCheckInterval == 0 &&
+             std::chrono::steady_clock::now() >= deadline_) {
+    outOfBudget_ = true;
+  }
+  return outOfBudget_;
 }
 
 void SearchEngine::stopSearch() {
-  if (running_.exchange(false)) {
+  if (running_.exchange(false) && searchThread_.joinable()) {
     searchThread_.join();
   }
 }
 
 auto SearchEngine::running() -> bool {
-  if (depth_ > targeDepth_) {
+  if (finished_) {
     stopSearch();
   }
   return running_;
@@ -320,4 +477,18 @@ void SearchEngine::setCallback(
   resultCallback_ = std::move(callback);
 }
 
+void SearchEngine::setBook(std::shared_ptr<const OpeningBook> book) {
+  stopSearch();
+  book_ = std::move(book);
+}
+
+void SearchEngine::setNetwork(
+    std::shared_ptr<const nnue::Network> network) {
+  stopSearch();
+  network_ = std::move(network);
+  // Entries of the other evaluator live under salted keys
+  killers_ = {};
+  pv_.reset();
+}
+
 } // namespace kamisado
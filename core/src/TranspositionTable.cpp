@@ -0,0 +1,200 @@
+#include "kamisado/TranspositionTable.hpp"
+#include "kamisado/MappedFile.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <span>
+#include <system_error>
+
+namespace kamisado {
+
+namespace {
+
+// FNV-1a
+auto checksum(std::span<const std::byte> bytes) -> uint64_t {
+  uint64_t hash{ 0xCBF29CE484222325ULL };
+  for (auto b : bytes) {
+    hash ^= static_cast<uint64_t>(b);
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+} // namespace
+
+TranspositionTable::TranspositionTable(size_t sizePow2)
+    : slots_(sizePow2) {
+  assert(std::has_single_bit(sizePow2) &&
+         "sizePow2 must be a power of 2");
+}
+
+auto TranspositionTable::sizeForBytes(size_t bytes) -> size_t {
+  return std::bit_floor(std::max(bytes / s_SlotBytes, size_t{ 1 }));
+}
+
+auto TranspositionTable::size() const -> size_t {
+  return slots_.size();
+}
+
+auto TranspositionTable::slot(uint64_t key) const -> const Slot& {
+  return slots_[key & (slots_.size() - 1)];
+}
+
+auto TranspositionTable::slot(uint64_t key) -> Slot& {
+  return slots_[key & (slots_.size() - 1)];
+}
+
+auto TranspositionTable::pack(const Entry& entry) -> uint64_t {
+  const auto move{ entry.hasBest ? entry.bestMove.encode() : uint16_t{ 0 } };
+  const auto depth{ static_cast<uint64_t>(
+      std::clamp(entry.depthRemaining, 0, 255)) };
+  const auto flags{ static_cast<uint64_t>(entry.bound) |
+                    (entry.hasBest ? 1U << 2U : 0U) };
+  return static_cast<uint32_t>(entry.score) |
+         (static_cast<uint64_t>(move) << 32U) | (depth << 48U) |
+         (flags << 56U);
+}
+
+auto TranspositionTable::unpack(uint64_t key, uint64_t data) -> Entry {
+  const auto flags{ static_cast<unsigned>(data >> 56U) };
+  const bool hasBest{ (flags & (1U << 2U)) != 0 };
+  return Entry{
+    .key            = key,
+    .depthRemaining = static_cast<int>((data >> 48U) & 0xFFU),
+    .score          = static_cast<int32_t>(data & 0xFFFFFFFFU),
+    .bound          = static_cast<Bound>(flags & 3U),
+    .bestMove       = hasBest ? Move::decode(static_cast<uint16_t>(
+                                    (data >> 32U) & 0xFFFFU))
+                              : Move{},
+    .hasBest        = hasBest,
+  };
+}
+
+auto TranspositionTable::probe(uint64_t key) const
+    -> std::optional<Entry> {
+  const Slot& s{ slot(key) };
+  const auto data{ s.data.load(std::memory_order_relaxed) };
+  const auto check{ s.check.load(std::memory_order_relaxed) };
+  if ((check ^ data) != key || (check == 0 && data == 0)) {
+    return std::nullopt;
+  }
+  return unpack(key, data);
+}
+
+void TranspositionTable::store(const Entry& entry) {
+  Slot& s{ slot(entry.key) };
+  const auto oldData{ s.data.load(std::memory_order_relaxed) };
+  const auto oldCheck{ s.check.load(std::memory_order_relaxed) };
+  const bool empty{ oldData == 0 && oldCheck == 0 };
+  // A racing writer may win, the table is only a hint
+  if (empty || entry.depthRemaining >= static_cast<int>(
+                                          (oldData >> 48U) & 0xFFU)) {
+    const auto data{ pack(entry) };
+    s.data.store(data, std::memory_order_relaxed);
+    s.check.store(entry.key ^ data, std::memory_order_relaxed);
+  }
+}
+
+void TranspositionTable::clear() {
+  for (auto& s : slots_) {
+    s.check.store(0, std::memory_order_relaxed);
+    s.data.store(0, std::memory_order_relaxed);
+  }
+}
+
+auto TranspositionTable::save(const std::filesystem::path& path,
+                              int minDepth) const -> size_t {
+  std::vector<SnapshotEntry> entries;
+  for (const auto& s : slots_) {
+    const auto data{ s.data.load(std::memory_order_relaxed) };
+    const auto check{ s.check.load(std::memory_order_relaxed) };
+    if (data == 0 && check == 0) {
+      continue;
+    }
+    auto e{ unpack(check ^ data, data) };
+    if (e.depthRemaining < minDepth) {
+      continue;
+    }
+    entries.push_back(SnapshotEntry{
+        .key            = e.key,
+        .score          = e.score,
+        .move           = static_cast<uint16_t>(data >> 32U),
+        .depthRemaining = static_cast<uint8_t>(data >> 48U),
+        .flags          = static_cast<uint8_t>(data >> 56U),
+    });
+  }
+
+  const std::span<const std::byte> payload{ std::as_bytes(
+      std::span{ entries }) };
+  const SnapshotHeader header{ .count    = entries.size(),
+                               .checksum = checksum(payload) };
+
+  // Write aside and rename, a crash never leaves a torn snapshot
+  auto tmpPath{ path };
+  tmpPath += ".tmp";
+  {
+    std::ofstream out{ tmpPath, std::ios::binary | std::ios::trunc };
+    out.write(reinterpret_cast<const char*>(&header), // NOLINT
+              sizeof(header));
+    out.write(reinterpret_cast<const char*>(payload.data()), // NOLINT
+              static_cast<std::streamsize>(payload.size()));
+    if (!out) {
+      throw SnapshotError(
+          fmt::format("Could not write {}", tmpPath.string()));
+    }
+  }
+  std::filesystem::rename(tmpPath, path);
+  return entries.size();
+}
+
+auto TranspositionTable::load(const std::filesystem::path& path)
+    -> size_t {
+  std::optional<MappedFile> file;
+  try {
+    file.emplace(path);
+  } catch (const std::system_error& e) {
+    throw SnapshotError(e.what());
+  }
+
+  auto bytes{ file->bytes() };
+  SnapshotHeader header;
+  if (bytes.size() < sizeof(header)) {
+    throw SnapshotError(
+        fmt::format("Truncated snapshot: {}", path.string()));
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (header.magic != s_SnapshotMagic ||
+      header.version != s_SnapshotVersion) {
+    throw SnapshotError(
+        fmt::format("Unsupported snapshot format: {}", path.string()));
+  }
+
+  auto payload{ bytes.subspan(sizeof(header)) };
+  if (payload.size() != header.count * sizeof(SnapshotEntry) ||
+      checksum(payload) != header.checksum) {
+    throw SnapshotError(
+        fmt::format("Corrupt snapshot: {}", path.string()));
+  }
+
+  const std::span<const SnapshotEntry> entries{
+    reinterpret_cast<const SnapshotEntry*>(payload.data()), // NOLINT
+    header.count
+  };
+  for (const auto& e : entries) {
+    const bool hasBest{ (e.flags & (1U << 2U)) != 0 };
+    store(Entry{
+        .key            = e.key,
+        .depthRemaining = e.depthRemaining,
+        .score          = e.score,
+        .bound          = static_cast<Bound>(e.flags & 3U),
+        .bestMove = hasBest ? Move::decode(e.move) : Move{},
+        .hasBest  = hasBest,
+    });
+  }
+  return entries.size();
+}
+
+} // namespace kamisado
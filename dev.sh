@@ -32,7 +32,7 @@ if [ $# -ne 0 ] ; then
     pushd build/tests > /dev/null
     rm -rf coverage
     mkdir -p coverage/report
-    test_name=specify_test_executable_in_dev_sh
+    test_name=kamisado-tests
     LLVM_PROFILE_FILE="coverage/%p.profraw" ./$test_name
     llvm-profdata merge -sparse coverage/*.profraw -o coverage/$test_name.profdata
     llvm-cov show ./$test_name -instr-profile=coverage/$test_name.profdata -format=html -output-dir=coverage/report --ignore-filename-regex=build/.*
@@ -0,0 +1,100 @@
+#include "utils/BinaryProtocol.h"
+#include <drogon/drogon_test.h>
+#include <limits>
+
+using namespace kamisado;
+
+DROGON_TEST(BinaryIntegersRoundTrip) {
+  std::string frame;
+  binary::Writer out{ frame };
+  out.u8(0xAB);
+  out.u16(0xBEEF);
+  out.u32(0xDEADBEEF);
+  out.i32(-42);
+  out.u64(std::numeric_limits<uint64_t>::max() - 1);
+  out.bytes("tail");
+
+  binary::Reader in{ frame };
+  CHECK(in.u8() == 0xAB);
+  CHECK(in.u16() == 0xBEEF);
+  CHECK(in.u32() == 0xDEADBEEF);
+  CHECK(in.i32() == -42);
+  CHECK(in.u64() == std::numeric_limits<uint64_t>::max() - 1);
+  CHECK(in.bytes(4) == "tail");
+  CHECK(in.done());
+}
+
+DROGON_TEST(BinaryIntegersAreLittleEndian) {
+  std::string frame;
+  binary::Writer{ frame }.u32(0x04030201);
+  REQUIRE(frame.size() == 4);
+  CHECK(frame == std::string({ 1, 2, 3, 4 }));
+}
+
+DROGON_TEST(BinaryReaderRejectsTruncatedFrames) {
+  std::string frame;
+  binary::Writer{ frame }.u16(7);
+  binary::Reader in{ frame };
+  CHECK_THROWS_AS(in.u32(), binary::ProtocolError);
+
+  binary::Reader empty{ std::string_view{} };
+  CHECK_THROWS_AS(empty.u8(), binary::ProtocolError);
+}
+
+DROGON_TEST(BinaryMovesRoundTrip) {
+  for (size_t from = 0; from < 64; from++) {
+    for (size_t to = 0; to < 64; to++) {
+      Move move{ .from = Coord{ from / 8, from % 8 },
+                 .to   = Coord{ to / 8, to % 8 } };
+      auto decoded = binary::decodeMove(move.encode());
+      REQUIRE(decoded.has_value());
+      CHECK(*decoded == move);
+    }
+  }
+  auto pass    = Move::pass(Coord{ 3, 4 });
+  auto decoded = binary::decodeMove(pass.encode());
+  REQUIRE(decoded.has_value());
+  CHECK(decoded->isPass);
+  CHECK(*decoded == pass);
+}
+
+DROGON_TEST(BinaryDecodeMoveRejectsHighBits) {
+  auto bits = Move{ .from = Coord{ 7, 0 }, .to = Coord{ 6, 0 } }.encode();
+  for (unsigned bit = 13; bit < 16; bit++) {
+    CHECK(!binary::decodeMove(static_cast<uint16_t>(bits | (1U << bit))));
+  }
+  CHECK(!binary::decodeMove(0xFFFF));
+}
+
+DROGON_TEST(BinarySquares) {
+  for (uint8_t square = 0; square < 64; square++) {
+    auto coord = binary::decodeSquare(square);
+    REQUIRE(coord.has_value());
+    CHECK(binary::encodeSquare(*coord) == square);
+  }
+  CHECK(!binary::decodeSquare(64));
+  CHECK(!binary::decodeSquare(binary::s_None));
+}
+
+DROGON_TEST(BinaryCellLayout) {
+  CHECK(binary::encodeCell(Color::Red, std::nullopt) ==
+        static_cast<uint8_t>(Color::Red));
+  auto cell = binary::encodeCell(
+      Color::Green,
+      Tower{ .owner = Player::Black, .color = Color::Orange });
+  CHECK((cell & 0x7U) == static_cast<unsigned>(Color::Green));
+  CHECK((cell & 0x8U) != 0);
+  CHECK(((cell >> 4U) & 1U) == static_cast<unsigned>(Player::Black));
+  CHECK((cell >> 5U) == static_cast<unsigned>(Color::Orange));
+}
+
+DROGON_TEST(BinaryOutcomeAndColor) {
+  CHECK(binary::encodeOutcome({}) == 0);
+  CHECK(binary::encodeOutcome({ .terminal = true,
+                                .winner   = Player::White }) == 1);
+  CHECK(binary::encodeOutcome({ .terminal = true,
+                                .winner   = Player::Black }) == 2);
+  CHECK(binary::encodeColor(std::nullopt) == binary::s_None);
+  CHECK(binary::encodeColor(Color::Pink) ==
+        static_cast<uint8_t>(Color::Pink));
+}
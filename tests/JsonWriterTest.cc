@@ -0,0 +1,96 @@
+#include "utils/JsonWriter.h"
+#include <drogon/drogon_test.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <limits>
+#include <memory>
+#include <optional>
+
+using namespace kamisado;
+
+namespace {
+
+auto parse(std::string_view text) -> std::optional<Json::Value> {
+  Json::CharReaderBuilder builder;
+  std::unique_ptr<Json::CharReader> reader{ builder.newCharReader() };
+  Json::Value value;
+  std::string errors;
+  if (!reader->parse(text.data(), text.data() + text.size(), &value,
+                     &errors)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+} // namespace
+
+DROGON_TEST(JsonWriterSeparatesValues) {
+  std::string buffer;
+  JsonWriter out{ buffer };
+  out.beginObject();
+  out.key("a").number(int64_t{ 1 });
+  out.key("b").beginArray();
+  out.boolean(true).null().beginObject().endObject();
+  out.endArray();
+  out.key("c").raw("[1,2]");
+  out.endObject();
+  CHECK(out.str() == R"({"a":1,"b":[true,null,{}],"c":[1,2]})");
+}
+
+DROGON_TEST(JsonWriterEscapesStrings) {
+  std::string buffer;
+  JsonWriter out{ buffer };
+  out.string("quote\" backslash\\ newline\n tab\t bell\x07");
+  CHECK(out.str() ==
+        R"("quote\" backslash\\ newline\u000a tab\u0009 bell\u0007")");
+
+  const std::string text{ "a\"b\\c\nd\x01 \xC3\xA9" };
+  JsonWriter writer{ buffer };
+  writer.beginObject().key("k\"ey").string(text).endObject();
+  auto value = parse(buffer);
+  REQUIRE(value.has_value());
+  CHECK((*value)["k\"ey"].asString() == text);
+}
+
+DROGON_TEST(JsonWriterNumbersRoundTrip) {
+  std::string buffer;
+  JsonWriter out{ buffer };
+  out.beginArray();
+  out.number(int64_t{ -9'007'199'254'740'993 });
+  out.number(std::numeric_limits<uint64_t>::max());
+  out.number(0.1);
+  out.number(-2.5e-7);
+  out.endArray();
+  auto value = parse(buffer);
+  REQUIRE(value.has_value());
+  CHECK((*value)[0].asInt64() == -9'007'199'254'740'993);
+  CHECK((*value)[1].asUInt64() == std::numeric_limits<uint64_t>::max());
+  CHECK((*value)[2].asDouble() == 0.1);
+  CHECK((*value)[3].asDouble() == -2.5e-7);
+}
+
+DROGON_TEST(JsonWriterReusesBuffer) {
+  std::string buffer;
+  JsonWriter{ buffer }.beginArray().number(int64_t{ 1 }).endArray();
+  JsonWriter out{ buffer };
+  CHECK(out.str().empty());
+  out.number(int64_t{ 2 });
+  CHECK(out.str() == "2");
+}
+
+DROGON_TEST(JsonWriterBoardParses) {
+  std::string buffer;
+  JsonWriter out{ buffer };
+  Board board{ BoardColoring::official() };
+  write(out, board);
+  auto value = parse(buffer);
+  REQUIRE(value.has_value());
+  REQUIRE(value->size() == config::BoardSize);
+  const auto& corner = (*value)[0][0];
+  CHECK(corner["color"].asString() ==
+        colorName(board.coloring().at(Coord{ 0, 0 })));
+  CHECK(corner.isMember("piece") ==
+        board.towerAt(Coord{ 0, 0 }).has_value());
+  CHECK(squareName(Coord{ 0, 0 }) == "a8");
+  CHECK(squareName(Coord{ 7, 7 }) == "h1");
+}
@@ -0,0 +1,7 @@
+#define DROGON_TEST_MAIN
+#include <drogon/drogon_test.h>
+
+// The tested code is pure, so the app itself is never started
+auto main(int argc, char** argv) -> int {
+  return drogon::test::run(argc, argv);
+}
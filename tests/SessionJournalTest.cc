@@ -0,0 +1,267 @@
+#include "plugins/SessionJournal.h"
+#include <drogon/drogon_test.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <random>
+
+using namespace kamisado;
+
+namespace {
+
+/// Fresh directory, removed with everything in it
+struct TempDir {
+  TempDir()
+      : path{ std::filesystem::temp_directory_path() /
+              fmt::format("kamisado-journal-{:x}",
+                          std::random_device{}()) } {
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+
+  TempDir(const TempDir&)                    = delete;
+  auto operator=(const TempDir&) -> TempDir& = delete;
+
+  std::filesystem::path path;
+};
+
+auto options(const TempDir& dir) -> SessionJournal::Options {
+  return { .dir           = dir.path,
+           .flushInterval = std::chrono::milliseconds{ 1 } };
+}
+
+auto move(size_t n) -> PersistedMove {
+  std::chrono::milliseconds ts{ 1'700'000'000'000 + n };
+  return { .move = Move{ .from = Coord{ 7, n % 8 },
+                         .to   = Coord{ 6, n % 8 } },
+           .ts   = std::chrono::system_clock::time_point{ ts } };
+}
+
+auto token(unsigned char fill) -> TokenHash {
+  TokenHash hash{};
+  hash.fill(fill);
+  return hash;
+}
+
+auto find(const std::vector<PersistedSession>& sessions, int id)
+    -> const PersistedSession* {
+  for (const auto& session : sessions) {
+    if (session.id == id) {
+      return &session;
+    }
+  }
+  return nullptr;
+}
+
+void truncate(const std::filesystem::path& path, size_t bytes) {
+  std::filesystem::resize_file(path,
+                               std::filesystem::file_size(path) - bytes);
+}
+
+void flipByte(const std::filesystem::path& path, size_t fromEnd) {
+  std::fstream file{ path, std::ios::binary | std::ios::in |
+                               std::ios::out };
+  auto offset = static_cast<std::streamoff>(
+      std::filesystem::file_size(path) - fromEnd);
+  file.seekg(offset);
+  char byte{};
+  file.read(&byte, 1);
+  byte = static_cast<char>(byte ^ 0x5A);
+  file.seekp(offset);
+  file.write(&byte, 1);
+}
+
+// Body of a move record: type, id, seq, move and timestamp
+constexpr size_t s_MoveRecord = 6 + 1 + 4 + 4 + 2 + 8;
+
+} // namespace
+
+DROGON_TEST(JournalRoundTrip) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id              = 5,
+                      .analysisEnabled = true,
+                      .engineSide      = Player::Black,
+                      .engineLevel     = 3 });
+    journal.joined(5, Player::White, token(0xA1));
+    journal.moved(5, 1, move(1));
+    journal.moved(5, 2, move(2));
+    journal.resigned(5, Player::White);
+    journal.stop();
+  }
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  const auto& session = sessions.front();
+  CHECK(session.id == 5);
+  CHECK(session.analysisEnabled);
+  CHECK(!session.useNetwork);
+  CHECK(session.engineSide == Player::Black);
+  CHECK(session.engineLevel == 3);
+  CHECK(session.tokens[static_cast<size_t>(Player::White)] ==
+        token(0xA1));
+  CHECK(!session.tokens[static_cast<size_t>(Player::Black)]);
+  REQUIRE(session.moves.size() == 2);
+  CHECK(session.moves[0].move == move(1).move);
+  CHECK(session.moves[1].move == move(2).move);
+  CHECK(session.moves[1].ts == move(2).ts);
+  CHECK(session.resignedBy == Player::White);
+}
+
+DROGON_TEST(JournalLeaveAndExpire) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 1 });
+    journal.created({ .id = 2 });
+    journal.joined(1, Player::White, token(1));
+    journal.joined(1, Player::Black, token(2));
+    journal.left(1, Player::White);
+    journal.joined(2, Player::White, token(3));
+    journal.expired(2);
+    // Records for a session that is gone are ignored
+    journal.moved(2, 1, move(1));
+  }
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  const auto* session = find(sessions, 1);
+  REQUIRE(session != nullptr);
+  CHECK(!session->tokens[static_cast<size_t>(Player::White)]);
+  CHECK(session->tokens[static_cast<size_t>(Player::Black)] == token(2));
+}
+
+DROGON_TEST(JournalIgnoresTornFinalRecord) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 7 });
+    journal.moved(7, 1, move(1));
+    journal.moved(7, 2, move(2));
+  }
+  truncate(dir.path / "journal.1", 3);
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  CHECK(sessions.front().moves.size() == 1);
+
+  // Only part of the frame header left
+  truncate(dir.path / "journal.1", s_MoveRecord - 3 - 4);
+  sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  CHECK(sessions.front().moves.size() == 1);
+}
+
+DROGON_TEST(JournalStopsAtChecksumMismatch) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 7 });
+    journal.moved(7, 1, move(1));
+    journal.moved(7, 2, move(2));
+    journal.moved(7, 3, move(3));
+  }
+  // Inside the body of the second move, the third is dropped with it
+  flipByte(dir.path / "journal.1", s_MoveRecord + 2);
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  CHECK(sessions.front().moves.size() == 1);
+}
+
+DROGON_TEST(JournalReplaysOverSnapshot) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 3, .useNetwork = true });
+    journal.joined(3, Player::White, token(9));
+    journal.moved(3, 1, move(1));
+    journal.created({ .id = 4 });
+
+    auto first = journal.rotate();
+    CHECK(journal.rotate() == first);
+    // Written after the rotation but also captured by the snapshot
+    journal.moved(3, 2, move(2));
+    journal.left(3, Player::White);
+
+    PersistedSession captured{ .id = 3, .useNetwork = true };
+    captured.moves = { move(1), move(2) };
+    std::string sessions;
+    SessionJournal::encode(sessions, captured);
+    SessionJournal::encode(sessions, { .id = 4 });
+    journal.writeSnapshot(std::move(sessions), first);
+
+    journal.moved(3, 3, move(3));
+    journal.expired(4);
+  }
+
+  CHECK(std::filesystem::exists(dir.path / "snapshot"));
+  CHECK(!std::filesystem::exists(dir.path / "journal.1"));
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  const auto& session = sessions.front();
+  CHECK(session.id == 3);
+  CHECK(session.useNetwork);
+  CHECK(!session.tokens[static_cast<size_t>(Player::White)]);
+  REQUIRE(session.moves.size() == 3);
+  for (size_t i = 0; i < session.moves.size(); i++) {
+    CHECK(session.moves[i].move == move(i + 1).move);
+  }
+}
+
+DROGON_TEST(JournalKeepsOldFileWhenRotationFails) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 6 });
+    // Opening a directory for writing fails
+    std::filesystem::create_directory(dir.path / "journal.2");
+    auto first = journal.rotate();
+    journal.moved(6, 1, move(1));
+
+    std::string sessions;
+    SessionJournal::encode(sessions, { .id = 6 });
+    journal.writeSnapshot(std::move(sessions), first);
+    journal.moved(6, 2, move(2));
+  }
+
+  CHECK(!std::filesystem::exists(dir.path / "snapshot"));
+  std::filesystem::remove(dir.path / "journal.2");
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  CHECK(sessions.front().moves.size() == 2);
+}
+
+DROGON_TEST(JournalContinuesAfterRestart) {
+  TempDir dir;
+  {
+    SessionJournal journal{ options(dir) };
+    journal.created({ .id = 8 });
+    journal.moved(8, 1, move(1));
+  }
+  {
+    SessionJournal journal{ options(dir) };
+    journal.moved(8, 2, move(2));
+  }
+  CHECK(std::filesystem::exists(dir.path / "journal.2"));
+
+  auto sessions = SessionJournal::replay(dir.path);
+  REQUIRE(sessions.size() == 1);
+  CHECK(sessions.front().moves.size() == 2);
+}
+
+DROGON_TEST(JournalReplayOfMissingDirectory) {
+  TempDir dir;
+  CHECK(SessionJournal::replay(dir.path / "absent").empty());
+}
+
+DROGON_TEST(JournalRejectsUnknownSnapshot) {
+  TempDir dir;
+  std::ofstream{ dir.path / "snapshot" } << "not a snapshot";
+  CHECK_THROWS_AS(SessionJournal::replay(dir.path), JournalError);
+}
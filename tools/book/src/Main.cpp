@@ -0,0 +1,172 @@
+#include "kamisado/MoveGen.hpp"
+#include "kamisado/OpeningBook.hpp"
+#include "kamisado/SearchEngine.hpp"
+#include <atomic>
+#include <fmt/format.h>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace kamisado;
+
+namespace {
+
+struct Args {
+  std::filesystem::path out;
+  std::filesystem::path nnue;
+  int plies{ 3 };
+  SearchEngine::Limits limits{ .maxNodes = 1'000'000 };
+  size_t ttSize{ 1U << 20U };
+  unsigned threads{ std::max(1U, std::thread::hardware_concurrency()) };
+};
+
+void usage() {
+  std::cerr << "Usage: kamisado-book --out FILE [--plies N] [--nodes N] "
+               "[--depth N] [--threads N] [--tt-bits N] [--nnue FILE]\n"
+               "Searches every position up to N plies from the start\n";
+}
+
+auto parseArgs(int argc, char** argv) -> std::optional<Args> {
+  Args args;
+  std::vector<std::string_view> argList(argv + 1, argv + argc);
+  for (size_t i = 0; i < argList.size(); i++) {
+    auto arg{ argList[i] };
+    if (i + 1 >= argList.size()) {
+      return std::nullopt;
+    }
+    std::string value{ argList[++i] };
+    if (arg == "--out") {
+      args.out = value;
+    } else if (arg == "--plies") {
+      args.plies = std::stoi(value);
+    } else if (arg == "--nodes") {
+      args.limits.maxNodes = std::stoull(value);
+    } else if (arg == "--depth") {
+      args.limits.maxDepth = std::stoi(value);
+      args.limits.maxNodes = 0;
+    } else if (arg == "--threads") {
+      args.threads = std::max(1UL, std::stoul(value));
+    } else if (arg == "--tt-bits") {
+      args.ttSize = size_t{ 1 } << std::stoul(value);
+    } else if (arg == "--nnue") {
+      args.nnue = value;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (args.out.empty()) {
+    return std::nullopt;
+  }
+  return args;
+}
+
+/// All distinct non-terminal positions within the given number of plies
+auto openingTree(int plies) -> std::vector<GameState> {
+  std::vector<GameState> positions{ GameState{ Board{} } };
+  std::unordered_set<uint64_t> seen{ positions.front().hash() };
+
+  size_t levelBegin{ 0 };
+  for (int ply = 0; ply < plies; ply++) {
+    const size_t levelEnd{ positions.size() };
+    for (size_t i = levelBegin; i < levelEnd; i++) {
+      for (auto&& move : MoveGen::legalMoves(positions[i])) {
+        GameState child{ positions[i].apply(move) };
+        if (child.terminalStatus().terminal ||
+            !seen.insert(child.hash()).second) {
+          continue;
+        }
+        positions.push_back(std::move(child));
+      }
+    }
+    levelBegin = levelEnd;
+  }
+  return positions;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  std::optional<Args> args;
+  try {
+    args = parseArgs(argc, argv);
+  } catch (const std::logic_error&) {
+    args.reset();
+  }
+  if (!args) {
+    usage();
+    return 1;
+  }
+
+  std::shared_ptr<const nnue::Network> network;
+  if (!args->nnue.empty()) {
+    try {
+      network = nnue::Network::load(args->nnue);
+    } catch (const nnue::NetworkLoadError& e) {
+      std::cerr << e.what() << '\n';
+      return 1;
+    }
+  }
+
+  const auto positions{ openingTree(args->plies) };
+  std::cout << fmt::format("{} positions within {} plies\n",
+                           positions.size(), args->plies);
+
+  // Empty for positions the search found no move for
+  std::vector<std::optional<OpeningBook::Entry>> found(positions.size());
+  std::atomic<size_t> next{ 0 };
+  std::atomic<size_t> done{ 0 };
+  std::mutex outMutex;
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned t = 0; t < args->threads; t++) {
+      workers.emplace_back([&] {
+        SearchEngine engine{ args->ttSize };
+        engine.setNetwork(network);
+        for (size_t i = next++; i < positions.size(); i = next++) {
+          const auto& s{ positions[i] };
+          auto result{ engine.search(s, args->limits) };
+          if (result.bestMove) {
+            found[i] = OpeningBook::Entry{
+              .key   = s.hash(),
+              .score = result.score,
+              .move  = result.bestMove->encode(),
+              .depth = static_cast<uint16_t>(result.depth),
+            };
+          }
+
+          const size_t finished{ ++done };
+          if (finished % 100 == 0 || finished == positions.size()) {
+            std::scoped_lock lock{ outMutex };
+            std::cout << fmt::format("{}/{}\n", finished,
+                                     positions.size());
+          }
+        }
+      });
+    }
+  }
+
+  std::vector<OpeningBook::Entry> entries;
+  entries.reserve(found.size());
+  for (const auto& entry : found) {
+    if (entry) {
+      entries.push_back(*entry);
+    }
+  }
+  if (entries.size() < found.size()) {
+    std::cerr << fmt::format("Skipped {} positions without a move\n",
+                             found.size() - entries.size());
+  }
+
+  try {
+    OpeningBook::write(args->out, std::move(entries));
+  } catch (const BookError& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  std::cout << fmt::format("Wrote {}\n", args->out.string());
+  return 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace kamisado::datagen {
+
+/// Blocking FIFO with a fixed capacity, producers wait while it is full
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_{ capacity } {
+  }
+
+  /// Drops the value if the queue is closed, also while waiting
+  void push(T value) {
+    std::unique_lock lock{ mutex_ };
+    notFull_.wait(lock, [this] {
+      return items_.size() < capacity_ || closed_;
+    });
+    if (closed_) {
+      return;
+    }
+    items_.push_back(std::move(value));
+    notEmpty_.notify_one();
+  }
+
+  /// Returns nullopt once closed and drained
+  auto pop() -> std::optional<T> {
+    std::unique_lock lock{ mutex_ };
+    notEmpty_.wait(lock, [this] {
+      return !items_.empty() || closed_;
+    });
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    T value{ std::move(items_.front()) };
+    items_.pop_front();
+    notFull_.notify_one();
+    return value;
+  }
+
+  void close() {
+    std::scoped_lock lock{ mutex_ };
+    closed_ = true;
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable notFull_;
+  std::condition_variable notEmpty_;
+  bool closed_{ false };
+};
+
+} // namespace kamisado::datagen
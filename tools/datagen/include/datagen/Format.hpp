@@ -0,0 +1,61 @@
+#pragma once
+#include "kamisado/GameState.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace kamisado::datagen {
+
+/// Training data stream:
+///   u32 magic, u32 version, then game blocks
+///   u32 game index, u16 record count, Record[count]
+/// All values little endian. A block is only valid once fully written,
+/// so an interrupted run can be resumed by dropping the torn tail.
+struct Record {
+  /// Square (row * 8 + col) of every tower, [player][color]
+  std::array<uint8_t, static_cast<size_t>(Player::Count) *
+                          static_cast<size_t>(Color::Count)>
+      towers{};
+  /// Bit 0: side to move, bits 1-4: forced color (Count = none)
+  uint8_t flags{ 0 };
+  /// Search score from the side to move, mates saturated
+  int16_t score{ 0 };
+  /// Final game result from the side to move: 1 win, -1 loss, 0 unknown
+  int8_t result{ 0 };
+
+  static constexpr size_t s_Size{ 20 };
+  static constexpr int16_t s_MateScore{ 32000 };
+
+  static auto pack(const GameState& s, int score) -> Record;
+  void serialize(std::string& out) const;
+};
+
+struct GameBlock {
+  uint32_t index{ 0 };
+  std::vector<Record> records;
+
+  static constexpr size_t s_HeaderSize{ 6 };
+
+  void serialize(std::string& out) const;
+};
+
+constexpr uint32_t Magic{ 0x3147444B }; // "KDG1"
+constexpr uint32_t Version{ 1 };
+constexpr size_t FileHeaderSize{ 8 };
+
+struct FormatError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+/// Validates an existing stream, truncates a torn trailing block and
+/// returns the indices of all completed games. Creates the file with a
+/// header if it does not exist.
+auto prepareOutput(const std::filesystem::path& path)
+    -> std::unordered_set<uint32_t>;
+
+} // namespace kamisado::datagen
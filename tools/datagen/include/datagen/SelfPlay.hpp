@@ -0,0 +1,33 @@
+#pragma once
+#include "datagen/Format.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/SearchEngine.hpp"
+#include <cstdint>
+#include <memory>
+
+namespace kamisado::datagen {
+
+struct SelfPlayOptions {
+  uint64_t nodes{ 20'000 };
+  int randomPlies{ 4 };
+  int maxPlies{ 400 };
+  uint64_t seed{ 0 };
+  size_t ttSize{ 1U << 18U };
+  std::shared_ptr<const nnue::Network> network;
+};
+
+/// Plays fixed-node engine-vs-engine games, one engine per worker
+class SelfPlay {
+public:
+  explicit SelfPlay(SelfPlayOptions options);
+
+  /// Deterministic for a given seed and index, so resumed runs do not
+  /// repeat games
+  auto play(uint32_t index) -> GameBlock;
+
+private:
+  SelfPlayOptions options_;
+  SearchEngine engine_;
+};
+
+} // namespace kamisado::datagen
@@ -0,0 +1,129 @@
+#include "datagen/Format.hpp"
+#include "kamisado/Evaluator.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+
+namespace kamisado::datagen {
+
+namespace {
+
+template <typename T>
+void putLE(std::string& out, T value) {
+  auto u = static_cast<std::make_unsigned_t<T>>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out.push_back(static_cast<char>((u >> (8 * i)) & 0xFFU));
+  }
+}
+
+template <typename T>
+auto getLE(const char* data) -> T {
+  std::make_unsigned_t<T> u{ 0 };
+  for (size_t i = 0; i < sizeof(T); i++) {
+    u |= static_cast<std::make_unsigned_t<T>>(
+             static_cast<uint8_t>(data[i]))
+         << (8 * i);
+  }
+  return static_cast<T>(u);
+}
+
+} // namespace
+
+auto Record::pack(const GameState& s, int score) -> Record {
+  Record r;
+  const auto& board{ s.board() };
+  for (size_t p = 0; p < static_cast<size_t>(Player::Count); p++) {
+    for (size_t c = 0; c < static_cast<size_t>(Color::Count); c++) {
+      const Coord pos{ board.towerPos(static_cast<Player>(p),
+                                      static_cast<Color>(c)) };
+      r.towers[(p * static_cast<size_t>(Color::Count)) + c] =
+          static_cast<uint8_t>((pos.row * config::BoardSize) + pos.col);
+    }
+  }
+
+  const auto forced{ static_cast<uint8_t>(
+      s.forcedColor().value_or(Color::Count)) };
+  r.flags = static_cast<uint8_t>(static_cast<uint8_t>(s.playerToMove()) |
+                                 (forced << 1U));
+
+  if (Evaluator::isMateScore(score)) {
+    r.score = score > 0 ? s_MateScore : -s_MateScore;
+  } else {
+    r.score = static_cast<int16_t>(
+        std::clamp(score, -s_MateScore + 1, s_MateScore - 1));
+  }
+  return r;
+}
+
+void Record::serialize(std::string& out) const {
+  out.append(reinterpret_cast<const char*>(towers.data()), // NOLINT
+             towers.size());
+  putLE(out, flags);
+  putLE(out, score);
+  putLE(out, result);
+}
+
+void GameBlock::serialize(std::string& out) const {
+  out.reserve(out.size() + s_HeaderSize +
+              (records.size() * Record::s_Size));
+  putLE(out, index);
+  putLE(out, static_cast<uint16_t>(records.size()));
+  for (const auto& record : records) {
+    record.serialize(out);
+  }
+}
+
+auto prepareOutput(const std::filesystem::path& path)
+    -> std::unordered_set<uint32_t> {
+  std::unordered_set<uint32_t> done;
+
+  if (!std::filesystem::exists(path)) {
+    std::ofstream out{ path, std::ios::binary };
+    std::string header;
+    putLE(header, Magic);
+    putLE(header, Version);
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    if (!out) {
+      throw FormatError(
+          fmt::format("Could not create {}", path.string()));
+    }
+    return done;
+  }
+
+  std::ifstream in{ path, std::ios::binary };
+  std::array<char, FileHeaderSize> header{};
+  in.read(header.data(), header.size());
+  if (!in || getLE<uint32_t>(header.data()) != Magic) {
+    throw FormatError(
+        fmt::format("{} is not a datagen stream", path.string()));
+  }
+  if (getLE<uint32_t>(header.data() + 4) != Version) {
+    throw FormatError(fmt::format("{} has unsupported version {}",
+                                  path.string(),
+                                  getLE<uint32_t>(header.data() + 4)));
+  }
+
+  const auto fileSize{ std::filesystem::file_size(path) };
+  uint64_t validEnd{ FileHeaderSize };
+  std::array<char, GameBlock::s_HeaderSize> blockHeader{};
+  while (in.read(blockHeader.data(), blockHeader.size())) {
+    const auto index{ getLE<uint32_t>(blockHeader.data()) };
+    const auto count{ getLE<uint16_t>(blockHeader.data() + 4) };
+    const uint64_t blockEnd{ validEnd + GameBlock::s_HeaderSize +
+                             (uint64_t{ count } * Record::s_Size) };
+    if (blockEnd > fileSize) {
+      break;
+    }
+    in.seekg(static_cast<std::streamoff>(blockEnd));
+    done.insert(index);
+    validEnd = blockEnd;
+  }
+  in.close();
+
+  if (validEnd != fileSize) {
+    std::filesystem::resize_file(path, validEnd);
+  }
+  return done;
+}
+
+} // namespace kamisado::datagen
@@ -0,0 +1,152 @@
+#include "datagen/BoundedQueue.hpp"
+#include "datagen/Format.hpp"
+#include "datagen/SelfPlay.hpp"
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace kamisado;
+using namespace kamisado::datagen;
+
+namespace {
+
+struct Args {
+  std::filesystem::path out;
+  std::filesystem::path nnue;
+  uint32_t games{ 1000 };
+  unsigned threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  SelfPlayOptions selfPlay;
+};
+
+void usage() {
+  std::cerr << "Usage: kamisado-datagen --out FILE [--games N] "
+               "[--nodes N] [--threads N] [--random-plies N] "
+               "[--seed N] [--tt-bits N] [--nnue FILE]\n"
+               "Appends to FILE if it exists, skipping finished games\n";
+}
+
+auto parseArgs(int argc, char** argv) -> std::optional<Args> {
+  Args args;
+  std::vector<std::string_view> argList(argv + 1, argv + argc);
+  for (size_t i = 0; i < argList.size(); i++) {
+    auto arg{ argList[i] };
+    if (i + 1 >= argList.size()) {
+      return std::nullopt;
+    }
+    std::string value{ argList[++i] };
+    if (arg == "--out") {
+      args.out = value;
+    } else if (arg == "--games") {
+      args.games = std::stoul(value);
+    } else if (arg == "--nodes") {
+      args.selfPlay.nodes = std::stoull(value);
+    } else if (arg == "--threads") {
+      args.threads = std::max(1UL, std::stoul(value));
+    } else if (arg == "--random-plies") {
+      args.selfPlay.randomPlies = std::stoi(value);
+    } else if (arg == "--seed") {
+      args.selfPlay.seed = std::stoull(value);
+    } else if (arg == "--tt-bits") {
+      args.selfPlay.ttSize = size_t{ 1 } << std::stoul(value);
+    } else if (arg == "--nnue") {
+      args.nnue = value;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (args.out.empty()) {
+    return std::nullopt;
+  }
+  return args;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  std::optional<Args> args;
+  try {
+    args = parseArgs(argc, argv);
+  } catch (const std::logic_error&) {
+    args.reset();
+  }
+  if (!args) {
+    usage();
+    return 1;
+  }
+
+  std::vector<uint32_t> pending;
+  try {
+    if (!args->nnue.empty()) {
+      args->selfPlay.network = nnue::Network::load(args->nnue);
+    }
+    auto done{ prepareOutput(args->out) };
+    for (uint32_t i = 0; i < args->games; i++) {
+      if (!done.contains(i)) {
+        pending.push_back(i);
+      }
+    }
+    std::cout << fmt::format("{} games done, {} to play on {} threads\n",
+                             done.size(), pending.size(), args->threads);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  // Workers block once this many finished games are waiting for disk
+  BoundedQueue<std::string> finished{ size_t{ args->threads } * 4 };
+  std::atomic<size_t> next{ 0 };
+  std::vector<std::jthread> workers;
+  workers.reserve(args->threads);
+  for (unsigned t = 0; t < args->threads; t++) {
+    workers.emplace_back([&] {
+      SelfPlay selfPlay{ args->selfPlay };
+      for (size_t i = next++; i < pending.size(); i = next++) {
+        std::string buf;
+        selfPlay.play(pending[i]).serialize(buf);
+        finished.push(std::move(buf));
+      }
+    });
+  }
+  std::jthread closer{ [&] {
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    finished.close();
+  } };
+
+  std::ofstream out{ args->out, std::ios::binary | std::ios::app };
+  const auto start{ std::chrono::steady_clock::now() };
+  size_t games{ 0 };
+  size_t positions{ 0 };
+  while (auto block = finished.pop()) {
+    out.write(block->data(), static_cast<std::streamsize>(block->size()));
+    out.flush();
+    if (!out) {
+      std::cerr << "Write failed\n";
+      // Workers finish their current game, which close() then drops,
+      // and are joined on return
+      next = pending.size();
+      finished.close();
+      return 1;
+    }
+
+    games++;
+    positions += (block->size() - GameBlock::s_HeaderSize) /
+                 Record::s_Size;
+    if (games % 100 == 0 || games == pending.size()) {
+      const std::chrono::duration<double> elapsed{
+        std::chrono::steady_clock::now() - start
+      };
+      std::cout << fmt::format(
+          "{}/{} games, {} positions, {:.1f} games/s\n", games,
+          pending.size(), positions,
+          static_cast<double>(games) / elapsed.count());
+    }
+  }
+  return 0;
+}
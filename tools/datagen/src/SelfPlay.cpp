@@ -0,0 +1,54 @@
+#include "datagen/SelfPlay.hpp"
+#include "kamisado/MoveGen.hpp"
+#include <random>
+
+namespace kamisado::datagen {
+
+SelfPlay::SelfPlay(SelfPlayOptions options)
+    : options_{ std::move(options) },
+      engine_{ options_.ttSize } {
+  engine_.setNetwork(options_.network);
+}
+
+auto SelfPlay::play(uint32_t index) -> GameBlock {
+  std::mt19937_64 rng{ options_.seed ^
+                       (0x9E3779B97F4A7C15ULL * (uint64_t{ index } + 1)) };
+  engine_.clearTable();
+
+  GameBlock block{ .index = index, .records = {} };
+  GameState s{ Board{} };
+
+  for (int ply = 0; ply < options_.maxPlies; ply++) {
+    auto moves{ MoveGen::legalMoves(s) };
+    if (moves.empty()) {
+      break;
+    }
+
+    if (ply < options_.randomPlies || moves.size() == 1) {
+      std::uniform_int_distribution<size_t> pick{ 0, moves.size() - 1 };
+      s = s.apply(moves[pick(rng)]);
+      continue;
+    }
+
+    auto result{ engine_.search(
+        s, SearchEngine::Limits{ .maxNodes = options_.nodes }) };
+    if (!result.bestMove) {
+      break;
+    }
+    block.records.push_back(Record::pack(s, result.score));
+    s = s.apply(*result.bestMove);
+  }
+
+  const auto status{ s.terminalStatus() };
+  for (auto& record : block.records) {
+    if (!status.terminal) {
+      record.result = 0;
+    } else {
+      const auto stm{ static_cast<Player>(record.flags & 1U) };
+      record.result = status.winner == stm ? 1 : -1;
+    }
+  }
+  return block;
+}
+
+} // namespace kamisado::datagen
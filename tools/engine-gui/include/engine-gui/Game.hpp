@@ -1,16 +1,26 @@
 #pragma once
 #include "kamisado/GameService.hpp"
 #include "kamisado/GameState.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
 #include "kamisado/SearchEngine.hpp"
 #include <raylib-cpp.hpp>
 #include <raylib.h>
+#include <filesystem>
 #include <unordered_set>
 
 namespace kamisado {
 
+struct EngineOptions {
+  std::shared_ptr<const nnue::Network> network;
+  std::shared_ptr<const OpeningBook> book;
+  /// Transposition table is restored from and saved to this file
+  std::filesystem::path tableSnapshot;
+};
+
 class Game {
 public:
-  Game();
+  explicit Game(EngineOptions options = {});
   ~Game();
 
   void run();
@@ -39,6 +49,8 @@ private:
   static constexpr int s_WindowSize        = 800;
   static constexpr int s_BoardSize         = 600;
   static constexpr int s_AdvantageBarWidth = 30;
+  // Shallow entries are cheap to recompute, keep the snapshot small
+  static constexpr int s_TableSnapshotMinDepth = 4;
   // NOLINTBEGIN
   static inline const raylib::Color s_MoveColor{ 0x00000055 };
   static inline const raylib::Color s_WhiteColor{ ::WHITE };
@@ -56,6 +68,9 @@ private:
   bool flipped_{ false };
   Player humanPlayer_{ Player::White };
   GameService s_;
+  std::shared_ptr<const nnue::Network> network_;
+  std::filesystem::path tableSnapshot_;
+  bool useNetwork_{ false };
 
   Rectangle boardRect_{};
   std::array<std::array<Rectangle, config::BoardSize>, config::BoardSize>
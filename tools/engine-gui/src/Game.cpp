@@ -46,8 +46,11 @@ auto rectCenter(const raylib::Rectangle& rect) -> raylib::Vector2 {
 
 } // namespace
 
-Game::Game()
-    : window_{ s_WindowSize, s_WindowSize, "Mu-Torere" } {
+Game::Game(EngineOptions options)
+    : window_{ s_WindowSize, s_WindowSize, "Mu-Torere" },
+      network_{ std::move(options.network) },
+      tableSnapshot_{ std::move(options.tableSnapshot) },
+      useNetwork_{ network_ != nullptr } {
   SetTargetFPS(60);
   rlImGuiSetup(true);
 
@@ -55,6 +58,16 @@ Game::Game()
     bestMove_  = result.bestMove;
     bestScore_ = result.score;
   });
+  s_.setEngineNetwork(useNetwork_ ? network_ : nullptr);
+  s_.setEngineBook(std::move(options.book));
+  if (!tableSnapshot_.empty() && std::filesystem::exists(tableSnapshot_)) {
+    try {
+      std::cout << fmt::format("Restored {} table entries\n",
+                               s_.loadEngineTable(tableSnapshot_));
+    } catch (const SnapshotError& e) {
+      std::cerr << e.what() << '\n';
+    }
+  }
 
   boardRect_ = { .x      = 0,
                  .y      = s_WindowSize - s_BoardSize,
@@ -76,6 +89,13 @@ Game::Game()
 }
 
 Game::~Game() {
+  if (!tableSnapshot_.empty()) {
+    try {
+      s_.saveEngineTable(tableSnapshot_, s_TableSnapshotMinDepth);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+    }
+  }
   rlImGuiShutdown();
 }
 
@@ -330,6 +350,15 @@ void Game::drawGUI() {
     showMoves_ = static_cast<ShowMoves>(showMovesVal);
   }
 
+  if (network_) {
+    if (ImGui::Checkbox("NNUE evaluation", &useNetwork_)) {
+      s_.setEngineNetwork(useNetwork_ ? network_ : nullptr);
+      if (state_ == State::Play) {
+        s_.startEngineSearch();
+      }
+    }
+  }
+
   ImGui::InputFloat("Engine max time, s", &engineMaxTimeSeconds_, 0.1F,
                     0.5F);
   ImGui::Text("Engine timer:");
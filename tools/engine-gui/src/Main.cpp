@@ -1,7 +1,30 @@
 #include "engine-gui/Game.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
+#include <iostream>
+#include <string_view>
+#include <vector>
 
-auto main() -> int {
-  kamisado::Game game;
+auto main(int argc, char** argv) -> int {
+  kamisado::EngineOptions options;
+
+  std::vector<std::string_view> args(argv + 1, argv + argc);
+  try {
+    for (size_t i = 0; i + 1 < args.size(); i += 2) {
+      if (args[i] == "--nnue") {
+        options.network = kamisado::nnue::Network::load(args[i + 1]);
+      } else if (args[i] == "--book") {
+        options.book = kamisado::OpeningBook::open(args[i + 1]);
+      } else if (args[i] == "--tt") {
+        options.tableSnapshot = args[i + 1];
+      }
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  kamisado::Game game{ std::move(options) };
   game.run();
   return 0;
 }
@@ -0,0 +1,30 @@
+#pragma once
+#include "kamisado/Nnue.hpp"
+#include "kamisado/SearchEngine.hpp"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace kamisado::match {
+
+/// One side of the match, e.g. "name=nnue,nodes=50000,nnue=net.knue"
+/// Keys: name, nodes, time (ms), depth, tt-bits, nnue
+struct EngineConfig {
+  std::string name;
+  SearchEngine::Limits limits;
+  size_t ttSize{ 1U << 18U };
+  std::filesystem::path nnue;
+  std::shared_ptr<const nnue::Network> network;
+
+  /// Throws std::invalid_argument on malformed specs
+  static auto parse(std::string_view spec) -> EngineConfig;
+};
+
+/// Plays one game from the given opening, returns the winner or
+/// nullopt when the ply limit is reached
+auto playGame(SearchEngine& white, const EngineConfig& whiteConfig,
+              SearchEngine& black, const EngineConfig& blackConfig,
+              GameState s, int maxPlies) -> std::optional<Player>;
+
+} // namespace kamisado::match
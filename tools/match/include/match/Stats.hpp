@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace kamisado::match {
+
+struct Sprt {
+  double elo0{ 0.0 };
+  double elo1{ 5.0 };
+  double alpha{ 0.05 };
+  double beta{ 0.05 };
+
+  [[nodiscard]] auto lowerBound() const -> double;
+  [[nodiscard]] auto upperBound() const -> double;
+};
+
+/// Game results from the first engine's point of view
+struct Stats {
+  uint64_t wins{ 0 };
+  uint64_t losses{ 0 };
+  uint64_t draws{ 0 };
+
+  [[nodiscard]] auto games() const -> uint64_t;
+  [[nodiscard]] auto score() const -> double;
+  /// Elo difference and half width of its 95% confidence interval
+  [[nodiscard]] auto elo() const -> std::pair<double, double>;
+  /// Generalized SPRT log-likelihood ratio of elo1 against elo0
+  [[nodiscard]] auto llr(const Sprt& sprt) const -> double;
+
+  [[nodiscard]] auto format(const Sprt& sprt) const -> std::string;
+};
+
+} // namespace kamisado::match
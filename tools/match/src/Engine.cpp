@@ -0,0 +1,80 @@
+#include "match/Engine.hpp"
+#include "kamisado/MoveGen.hpp"
+#include <fmt/format.h>
+#include <ranges>
+#include <stdexcept>
+
+namespace kamisado::match {
+
+auto EngineConfig::parse(std::string_view spec) -> EngineConfig {
+  EngineConfig config;
+  for (auto&& part : std::views::split(spec, ',')) {
+    std::string_view kv{ part.begin(), part.end() };
+    auto eq{ kv.find('=') };
+    if (eq == std::string_view::npos) {
+      throw std::invalid_argument("Expected key=value in engine spec");
+    }
+    auto key{ kv.substr(0, eq) };
+    std::string value{ kv.substr(eq + 1) };
+    if (key == "name") {
+      config.name = value;
+    } else if (key == "nodes") {
+      config.limits.maxNodes = std::stoull(value);
+    } else if (key == "time") {
+      config.limits.maxTime = std::chrono::milliseconds{ std::stoll(value) };
+    } else if (key == "depth") {
+      config.limits.maxDepth = std::stoi(value);
+    } else if (key == "tt-bits") {
+      config.ttSize = size_t{ 1 } << std::stoul(value);
+    } else if (key == "nnue") {
+      config.nnue = value;
+    } else {
+      throw std::invalid_argument("Unknown engine option");
+    }
+  }
+
+  constexpr uint64_t defaultNodes{ 20'000 };
+  if (config.limits.maxNodes == 0 && config.limits.maxTime.count() == 0 &&
+      config.limits.maxDepth == config::MaxDepth) {
+    config.limits.maxNodes = defaultNodes;
+  }
+  if (!config.nnue.empty()) {
+    config.network = nnue::Network::load(config.nnue);
+  }
+  return config;
+}
+
+auto playGame(SearchEngine& white, const EngineConfig& whiteConfig,
+              SearchEngine& black, const EngineConfig& blackConfig,
+              GameState s, int maxPlies) -> std::optional<Player> {
+  white.clearTable();
+  black.clearTable();
+
+  for (int ply = 0; ply < maxPlies; ply++) {
+    const auto status{ s.terminalStatus() };
+    if (status.terminal) {
+      return status.winner;
+    }
+
+    auto moves{ MoveGen::legalMoves(s) };
+    if (moves.size() == 1) {
+      s = s.apply(moves.front());
+      continue;
+    }
+
+    const bool whiteToMove{ s.playerToMove() == Player::White };
+    auto& engine{ whiteToMove ? white : black };
+    const auto& config{ whiteToMove ? whiteConfig : blackConfig };
+    auto result{ engine.search(s, config.limits) };
+    if (!result.bestMove) {
+      // Forfeits rather than stalling the match on a broken engine
+      fmt::print(stderr, "{} found no move, scoring a loss\n",
+                 config.name);
+      return opposite(s.playerToMove());
+    }
+    s = s.apply(*result.bestMove);
+  }
+  return s.terminalStatus().winner;
+}
+
+} // namespace kamisado::match
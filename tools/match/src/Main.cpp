@@ -0,0 +1,185 @@
+#include "kamisado/MoveGen.hpp"
+#include "match/Engine.hpp"
+#include "match/Stats.hpp"
+#include <atomic>
+#include <fmt/format.h>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace kamisado;
+using namespace kamisado::match;
+
+namespace {
+
+struct Args {
+  std::vector<EngineConfig> engines;
+  uint64_t maxGames{ 2000 };
+  unsigned threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  int randomPlies{ 4 };
+  int maxPlies{ 400 };
+  uint64_t seed{ std::random_device{}() };
+  Sprt sprt;
+};
+
+void usage() {
+  std::cerr
+      << "Usage: kamisado-match --engine SPEC --engine SPEC [--games N] "
+         "[--threads N] [--random-plies N] [--max-plies N] [--seed N] "
+         "[--elo0 E] [--elo1 E] [--alpha A] [--beta B]\n"
+         "SPEC: comma separated name=, nodes=, time=(ms), depth=, "
+         "tt-bits=, nnue=\n";
+}
+
+auto parseArgs(int argc, char** argv) -> std::optional<Args> {
+  Args args;
+  std::vector<std::string_view> argList(argv + 1, argv + argc);
+  for (size_t i = 0; i < argList.size(); i++) {
+    auto arg{ argList[i] };
+    if (i + 1 >= argList.size()) {
+      return std::nullopt;
+    }
+    std::string value{ argList[++i] };
+    if (arg == "--engine") {
+      args.engines.push_back(EngineConfig::parse(value));
+    } else if (arg == "--games") {
+      args.maxGames = std::stoull(value);
+    } else if (arg == "--threads") {
+      args.threads = std::max(1UL, std::stoul(value));
+    } else if (arg == "--random-plies") {
+      args.randomPlies = std::stoi(value);
+    } else if (arg == "--max-plies") {
+      args.maxPlies = std::stoi(value);
+    } else if (arg == "--seed") {
+      args.seed = std::stoull(value);
+    } else if (arg == "--elo0") {
+      args.sprt.elo0 = std::stod(value);
+    } else if (arg == "--elo1") {
+      args.sprt.elo1 = std::stod(value);
+    } else if (arg == "--alpha") {
+      args.sprt.alpha = std::stod(value);
+    } else if (arg == "--beta") {
+      args.sprt.beta = std::stod(value);
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (args.engines.size() != 2) {
+    return std::nullopt;
+  }
+  for (size_t e = 0; e < args.engines.size(); e++) {
+    if (args.engines[e].name.empty()) {
+      args.engines[e].name = fmt::format("engine{}", e + 1);
+    }
+  }
+  return args;
+}
+
+/// Both games of a pair start here, with colors swapped
+auto randomOpening(uint64_t seed, uint64_t pair, int plies) -> GameState {
+  std::mt19937_64 rng{ seed ^ (0x9E3779B97F4A7C15ULL * (pair + 1)) };
+  while (true) {
+    GameState s{ Board{} };
+    for (int ply = 0; ply < plies; ply++) {
+      auto moves{ MoveGen::legalMoves(s) };
+      if (moves.empty()) {
+        break;
+      }
+      std::uniform_int_distribution<size_t> pick{ 0, moves.size() - 1 };
+      s = s.apply(moves[pick(rng)]);
+    }
+    if (!s.terminalStatus().terminal) {
+      return s;
+    }
+  }
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  std::optional<Args> args;
+  try {
+    args = parseArgs(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    args.reset();
+  }
+  if (!args) {
+    usage();
+    return 1;
+  }
+
+  const auto& first{ args->engines[0] };
+  const auto& second{ args->engines[1] };
+  std::cout << fmt::format("{} vs {}, up to {} games on {} threads, "
+                           "SPRT elo0={} elo1={} alpha={} beta={}\n",
+                           first.name, second.name, args->maxGames,
+                           args->threads, args->sprt.elo0,
+                           args->sprt.elo1, args->sprt.alpha,
+                           args->sprt.beta);
+
+  std::mutex statsMutex;
+  Stats stats;
+  std::atomic<bool> decided{ false };
+  std::atomic<uint64_t> nextPair{ 0 };
+  const uint64_t pairs{ (args->maxGames + 1) / 2 };
+
+  auto record = [&](std::optional<Player> winner, Player firstSide) {
+    if (!winner) {
+      stats.draws++;
+    } else if (*winner == firstSide) {
+      stats.wins++;
+    } else {
+      stats.losses++;
+    }
+  };
+
+  std::vector<std::jthread> workers;
+  workers.reserve(args->threads);
+  for (unsigned t = 0; t < args->threads; t++) {
+    workers.emplace_back([&] {
+      SearchEngine a{ first.ttSize };
+      SearchEngine b{ second.ttSize };
+      a.setNetwork(first.network);
+      b.setNetwork(second.network);
+
+      for (uint64_t pair = nextPair++; pair < pairs && !decided;
+           pair = nextPair++) {
+        const auto opening{ randomOpening(args->seed, pair,
+                                          args->randomPlies) };
+        auto firstAsWhite{ playGame(a, first, b, second, opening,
+                                    args->maxPlies) };
+        auto firstAsBlack{ playGame(b, second, a, first, opening,
+                                    args->maxPlies) };
+
+        std::scoped_lock lock{ statsMutex };
+        record(firstAsWhite, Player::White);
+        record(firstAsBlack, Player::Black);
+        const double llr{ stats.llr(args->sprt) };
+        if (llr <= args->sprt.lowerBound() ||
+            llr >= args->sprt.upperBound()) {
+          decided = true;
+        }
+        if (stats.games() % 20 == 0 || decided) {
+          std::cout << stats.format(args->sprt) << '\n';
+        }
+      }
+    });
+  }
+  workers.clear();
+
+  std::cout << "Final: " << stats.format(args->sprt) << '\n';
+  const double llr{ stats.llr(args->sprt) };
+  if (llr >= args->sprt.upperBound()) {
+    std::cout << fmt::format("H1 accepted: {} is stronger\n", first.name);
+  } else if (llr <= args->sprt.lowerBound()) {
+    std::cout << fmt::format("H0 accepted: {} is not stronger\n",
+                             first.name);
+  } else {
+    std::cout << "Inconclusive\n";
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include "match/Stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <utility>
+
+namespace kamisado::match {
+
+namespace {
+
+auto eloToScore(double elo) -> double {
+  return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+auto scoreToElo(double score) -> double {
+  constexpr double eps{ 1e-6 };
+  score = std::clamp(score, eps, 1.0 - eps);
+  return -400.0 * std::log10((1.0 / score) - 1.0);
+}
+
+} // namespace
+
+auto Sprt::lowerBound() const -> double {
+  return std::log(beta / (1.0 - alpha));
+}
+
+auto Sprt::upperBound() const -> double {
+  return std::log((1.0 - beta) / alpha);
+}
+
+auto Stats::games() const -> uint64_t {
+  return wins + losses + draws;
+}
+
+auto Stats::score() const -> double {
+  if (games() == 0) {
+    return 0.5;
+  }
+  return (static_cast<double>(wins) + (0.5 * static_cast<double>(draws))) /
+         static_cast<double>(games());
+}
+
+auto Stats::elo() const -> std::pair<double, double> {
+  const auto n{ static_cast<double>(games()) };
+  if (n == 0) {
+    return { 0.0, 0.0 };
+  }
+  const double p{ score() };
+  const double variance{
+    ((static_cast<double>(wins) * std::pow(1.0 - p, 2)) +
+     (static_cast<double>(draws) * std::pow(0.5 - p, 2)) +
+     (static_cast<double>(losses) * std::pow(p, 2))) /
+    n
+  };
+  constexpr double z95{ 1.959964 };
+  const double margin{ z95 * std::sqrt(variance / n) };
+  const double elo{ scoreToElo(p) };
+  return { elo, (scoreToElo(p + margin) - scoreToElo(p - margin)) / 2 };
+}
+
+auto Stats::llr(const Sprt& sprt) const -> double {
+  if (games() == 0) {
+    return 0.0;
+  }
+  // Half a game added to each outcome keeps the variance positive, so
+  // a side that never wins or never loses still moves the LLR
+  constexpr double prior{ 0.5 };
+  const double w{ static_cast<double>(wins) + prior };
+  const double d{ static_cast<double>(draws) + prior };
+  const double l{ static_cast<double>(losses) + prior };
+  const double n{ w + d + l };
+  const double p{ (w + (0.5 * d)) / n };
+  const double variance{ ((w * std::pow(1.0 - p, 2)) +
+                          (d * std::pow(0.5 - p, 2)) +
+                          (l * std::pow(p, 2))) /
+                         n };
+  if (variance <= 0) {
+    return 0.0;
+  }
+  const double s0{ eloToScore(sprt.elo0) };
+  const double s1{ eloToScore(sprt.elo1) };
+  return n * (s1 - s0) * ((2 * p) - s0 - s1) / (2 * variance);
+}
+
+auto Stats::format(const Sprt& sprt) const -> std::string {
+  auto [diff, margin] = elo();
+  return fmt::format(
+      "Games {} (+{} -{} ={}), score {:.1f}%, Elo {:+.1f} +/- {:.1f}, "
+      "LLR {:.2f} [{:.2f}, {:.2f}]",
+      games(), wins, losses, draws, 100.0 * score(), diff, margin,
+      llr(sprt), sprt.lowerBound(), sprt.upperBound());
+}
+
+} // namespace kamisado::match
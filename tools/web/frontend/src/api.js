@@ -1,10 +1,11 @@
 const API_BASE = import.meta.env.VITE_BACKEND_ORIGIN ?? "https://clarity-bibliographic-income-owen.trycloudflare.com";
 
-export async function createSession({analysisEnabled}) {
+// engine: optional {side:"white"|"black", level} to play against the server
+export async function createSession({analysisEnabled, engine}) {
   const res = await fetch(`${API_BASE}/api/sessions`, {
     method: "POST",
     headers: {"Content-Type": "application/json"},
-    body: JSON.stringify({analysisEnabled})
+    body: JSON.stringify({analysisEnabled, engine})
   });
   if (!res.ok) throw new Error(`createSession failed: ${res.status}`);
   return await res.json();
@@ -29,7 +30,15 @@ export async function fetchState({sessionId, token}) {
   return await res.json();
 }
 
+// Socket of the current session, moves go over it while it is open
+let liveSocket = null;
+
 export async function sendMove({sessionId, token, from, to}) {
+  if (liveSocket?.readyState === WebSocket.OPEN) {
+    // Rejections come back as { type:"error" } messages
+    liveSocket.send(JSON.stringify({type: "move", from, to}));
+    return;
+  }
   const res = await fetch(`${API_BASE}/api/sessions/${sessionId}/move`, {
     method: "POST",
     headers: {
@@ -44,14 +53,20 @@ export async function sendMove({sessionId, token, from, to}) {
 
 /**
  * WebSocket messages expected (examples):
- *  - { type:"state", payload:{...fullState} }
- *  - { type:"delta", payload:{...partial} }  (optional)
+ *  - { type:"state", payload:{...fullState} }  (on connect)
+ *  - { type:"delta", payload:{ seq, move, pass, tower, forcedColor, turnSide, legalMovesMap, terminal } }
  *  - { type:"analysis", payload:{ bestMove:{from:"a1",to:"a2"}, advantage:0.35 } }
  *  - { type:"terminal", payload:{ status:"win", winner:"white", reason:"..." } }
+ *  - { type:"error", payload:{ message } }  (only to the sender of a bad command)
+ * Commands accepted: { type:"move", from, to }, { type:"resign" }, { type:"state" },
+ * { type:"leave" } (frees the seat and closes the socket; a plain disconnect keeps it)
+ * Non-browser clients may pass proto=binary for the compact frames described
+ * in server/utils/BinaryProtocol.h; this UI stays on JSON.
  */
 export function openSessionSocket({sessionId, token, onMessage, onOpen, onClose, onError}) {
   const qs = token ? `?token=${encodeURIComponent(token)}&sid=${sessionId}` : "";
   const ws = new WebSocket(`${API_BASE}/ws/sessions${qs}`);
+  liveSocket = ws;
 
   ws.onopen = () => onOpen?.();
   ws.onclose = () => onClose?.();
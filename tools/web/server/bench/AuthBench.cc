@@ -0,0 +1,60 @@
+/// Cost of authenticating one request: a token hash and a sharded lookup.
+/// Usage: kamisado-server-auth-bench [sessions] [iterations]
+#include "plugins/SessionManagerPlugin.h"
+#include <chrono>
+#include <drogon/drogon.h>
+#include <fmt/format.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace kamisado;
+
+namespace {
+
+void run(size_t sessions, size_t iterations) {
+  auto* manager = drogon::app().getPlugin<SessionManagerPlugin>();
+  std::vector<Token> tokens;
+  tokens.reserve(sessions * 2);
+  for (size_t i = 0; i < sessions; i++) {
+    auto id = manager->create({});
+    tokens.push_back(manager->join(id, Player::White));
+    tokens.push_back(manager->join(id, Player::Black));
+  }
+
+  size_t hits{ 0 };
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    hits += manager->auth(tokens[i % tokens.size()]).has_value() ? 1 : 0;
+  }
+  std::chrono::duration<double, std::nano> elapsed{
+    std::chrono::steady_clock::now() - start
+  };
+
+  std::cout << fmt::format(
+      "{} tokens, {} lookups, {} hits: {:.1f} ns/auth\n", tokens.size(),
+      iterations, hits, elapsed.count() / static_cast<double>(iterations));
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  size_t sessions   = argc > 1 ? std::stoul(argv[1]) : 1'000;
+  size_t iterations = argc > 2 ? std::stoul(argv[2]) : 1'000'000;
+
+  Json::Value plugin;
+  plugin["name"]                       = "kamisado::SessionManagerPlugin";
+  plugin["config"]["analysis_threads"] = 1;
+  Json::Value config;
+  config["plugins"].append(plugin);
+  drogon::app().loadConfigJson(config);
+  drogon::app().setLogLevel(trantor::Logger::kWarn);
+
+  // Runs once the IO loops and plugins are up
+  drogon::app().getLoop()->queueInLoop([=] {
+    run(sessions, iterations);
+    drogon::app().quit();
+  });
+  drogon::app().run();
+  return 0;
+}
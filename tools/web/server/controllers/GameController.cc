@@ -1,73 +1,224 @@
 #include "GameController.h"
 #include "drogon/HttpResponse.h"
 #include "drogon/HttpTypes.h"
+#include "kamisado/Evaluator.hpp"
 #include "plugins/SessionManagerPlugin.h"
+#include "utils/Json.h"
+#include "utils/Metrics.h"
 #include "utils/Utils.h"
+#include <algorithm>
 
 namespace kamisado {
 
+namespace {
+
+/// If-None-Match holds "*" or a list of possibly weak tags
+auto etagMatches(std::string_view header, std::string_view etag) -> bool {
+  while (!header.empty()) {
+    auto comma = header.find(',');
+    auto tag   = header.substr(0, comma);
+    header.remove_prefix(comma == std::string_view::npos ? header.size()
+                                                         : comma + 1);
+    while (!tag.empty() && tag.front() == ' ') {
+      tag.remove_prefix(1);
+    }
+    while (!tag.empty() && tag.back() == ' ') {
+      tag.remove_suffix(1);
+    }
+    if (tag.starts_with("W/")) {
+      tag.remove_prefix(2);
+    }
+    if (tag == "*" || tag == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Drop in normalized expectation, see Evaluator::normalize, that makes a
+// move a blunder
+constexpr float s_BlunderDrop{ 0.3F };
+
+/// positions[i] is the position before moves[i], results match positions
+auto annotate(const std::vector<Move>& moves,
+              const std::vector<GameState>& positions,
+              const std::vector<SearchEngine::Result>& results)
+    -> Json::Value {
+  // Score of a position for the player who moved into it
+  auto scoreAfter = [&](size_t i, Player mover) {
+    const auto& next = positions[i + 1];
+    if (auto outcome = next.terminalStatus(); outcome.terminal) {
+      return Evaluator::mateScore(outcome.winner == mover, 0);
+    }
+    return -results[i + 1].score;
+  };
+
+  Json::Value out(Json::arrayValue);
+  for (size_t i = 0; i < moves.size(); i++) {
+    const auto& move   = moves[i];
+    const auto& search = results[i];
+    auto mover         = positions[i].playerToMove();
+    auto after         = scoreAfter(i, mover);
+    auto whiteAfter    = mover == Player::White ? after : -after;
+    auto drop          = std::max(Evaluator::normalize(search.score) -
+                                      Evaluator::normalize(after),
+                                  0.0F);
+    bool best = move.isPass || search.bestMove == move;
+
+    Json::Value entry = toJson(move);
+    entry["side"]     = toJson(mover);
+    entry["pass"]     = move.isPass;
+    entry["advantageWhite"]      = Evaluator::normalize(whiteAfter);
+    entry["formattedScoreWhite"] = Evaluator::formatScoreNorm(whiteAfter);
+    entry["bestMove"] =
+        search.bestMove ? toJson(*search.bestMove) : Json::Value{};
+    entry["best"]    = best;
+    entry["blunder"] = !best && drop >= s_BlunderDrop;
+    entry["loss"]    = drop;
+    out.append(entry);
+  }
+  return out;
+}
+
+} // namespace
+
 void GameController::move(
     const HttpRequestPtr& req,
     std::function<void(const HttpResponsePtr&)>&& callback,
     int sessionID) {
+  auto start = std::chrono::steady_clock::now();
+  SessionPtr sessionPtr;
   try {
-    auto& session =
-        app().getPlugin<SessionManagerPlugin>()->get(sessionID);
+    sessionPtr = app().getPlugin<SessionManagerPlugin>()->get(sessionID);
+  } catch (const SessionException& e) {
+    sendJsonError(e.what(), std::move(callback));
+    return;
+  }
 
+  auto authRes = authIdentity(req);
+  if (!authRes || authRes->first != sessionID) {
+    sendJsonError("Unauthorized", std::move(callback),
+                  drogon::k401Unauthorized);
+    return;
+  }
 
-    auto [authSessionID, authPlayer] =
-        *app().getPlugin<SessionManagerPlugin>()->auth(parseToken(req));
-    if (authSessionID != sessionID) {
-      sendJsonError("Unauthorized", std::move(callback),
-                    drogon::k401Unauthorized);
-      return;
-    }
+  auto body{ req->jsonObject() };
+  if (!body) {
+    sendJsonError("No json body", std::move(callback));
+    return;
+  }
 
-    if (authPlayer != session.playerToMove()) {
-      sendJsonError("Not your turn", std::move(callback));
-      return;
-    }
+  if (!body->isMember("from") || !body->isMember("to")) {
+    sendJsonError("No from/to field", std::move(callback));
+    return;
+  }
 
-    auto body{ req->jsonObject() };
-    if (!body) {
-      sendJsonError("No json body", std::move(callback));
-      return;
-    }
+  auto from = fileRankToCoord((*body)["from"].asString());
+  auto to   = fileRankToCoord((*body)["to"].asString());
+  if (!from || !to) {
+    sendJsonError("Invalid from/to", std::move(callback));
+    return;
+  }
 
-    if (!body->isMember("from") || !body->isMember("to")) {
-      sendJsonError("No from/to field", std::move(callback));
+  Move move{ .from = *from, .to = *to };
+  sessionPtr->post([move, player = authRes->second, start,
+                    callback = std::move(callback)](
+                       Session& session) mutable {
+    if (player != session.playerToMove()) {
+      sendJsonError("Not your turn", std::move(callback));
       return;
     }
-
-    auto from = fileRankToCoord((*body)["from"].asString());
-    auto to   = fileRankToCoord((*body)["to"].asString());
-    if (!from || !to) {
-      sendJsonError("Invalid from/to", std::move(callback));
-      return;
+    try {
+      session.makeMove(move);
+      callback(HttpResponse::newHttpResponse());
+      metrics::observe(metrics::Histogram::MoveLatency,
+                       std::chrono::steady_clock::now() - start);
+    } catch (const SessionException& e) {
+      sendJsonError(e.what(), std::move(callback));
     }
+  });
+}
 
-    Move move{ .from = *from, .to = *to };
-    session.makeMove(move);
-    callback(HttpResponse::newHttpResponse());
+void GameController::state(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    int sessionID) {
+  SessionPtr sessionPtr;
+  try {
+    sessionPtr = app().getPlugin<SessionManagerPlugin>()->get(sessionID);
   } catch (const SessionException& e) {
     sendJsonError(e.what(), std::move(callback));
     return;
   }
+
+  sessionPtr->post([ifNoneMatch = req->getHeader("if-none-match"),
+                    callback = std::move(callback)](Session& session) {
+    const auto& etag = session.stateETag();
+    auto resp        = HttpResponse::newHttpResponse();
+    // Clients revalidate every poll, unchanged state costs no body
+    resp->addHeader("ETag", etag);
+    resp->addHeader("Cache-Control", "no-cache");
+    if (etagMatches(ifNoneMatch, etag)) {
+      resp->setStatusCode(k304NotModified);
+    } else {
+      resp->setContentTypeCode(CT_APPLICATION_JSON);
+      resp->setBody(session.stateBody());
+    }
+    callback(resp);
+  });
 }
 
-void GameController::state(
+void GameController::review(
     const HttpRequestPtr& req,
     std::function<void(const HttpResponsePtr&)>&& callback,
     int sessionID) {
-  Session* session = nullptr;
+  auto* manager = app().getPlugin<SessionManagerPlugin>();
+  SessionPtr sessionPtr;
   try {
-    session = &app().getPlugin<SessionManagerPlugin>()->get(sessionID);
+    sessionPtr = manager->get(sessionID);
   } catch (const SessionException& e) {
     sendJsonError(e.what(), std::move(callback));
     return;
   }
 
-  callback(HttpResponse::newHttpJsonResponse(session->stateJson()));
+  auto authRes = authIdentity(req);
+  if (!authRes || authRes->first != sessionID) {
+    sendJsonError("Unauthorized", std::move(callback),
+                  drogon::k401Unauthorized);
+    return;
+  }
+
+  sessionPtr->post([manager, callback = std::move(callback)](
+                       Session& session) mutable {
+    if (!session.outcome().terminal) {
+      sendJsonError("Game is not over", std::move(callback),
+                    drogon::k409Conflict);
+      return;
+    }
+
+    std::vector<Move> moves;
+    std::vector<GameState> positions{ GameState{
+        Board{ BoardColoring::official() } } };
+    for (const auto& entry : session.moves()) {
+      moves.push_back(entry.move);
+      positions.push_back(positions.back().apply(entry.move));
+    }
+
+    manager->reviewGame(
+        positions, session.useNetwork(),
+        [moves, positions, callback = std::move(callback)](
+            std::optional<std::vector<SearchEngine::Result>>
+                results) mutable {
+          if (!results) {
+            sendJsonError("Server is shutting down", std::move(callback),
+                          drogon::k503ServiceUnavailable);
+            return;
+          }
+          Json::Value body;
+          body["moves"] = annotate(moves, positions, *results);
+          callback(HttpResponse::newHttpJsonResponse(std::move(body)));
+        });
+  });
 }
 
 } // namespace kamisado
@@ -13,6 +13,8 @@ public:
                 Options, "kamisado::AuthFilter");
   ADD_METHOD_TO(GameController::state, "/api/sessions/{1}/state", Get,
                 Options, "kamisado::AuthFilter");
+  ADD_METHOD_TO(GameController::review, "/api/sessions/{1}/review", Get,
+                Options, "kamisado::AuthFilter");
   METHOD_LIST_END
 
   void move(const HttpRequestPtr& req,
@@ -22,6 +24,12 @@ public:
   void state(const HttpRequestPtr& req,
              std::function<void(const HttpResponsePtr&)>&& callback,
              int sessionID);
+
+  /// Scores every move of a finished game and marks best moves and
+  /// blunders
+  void review(const HttpRequestPtr& req,
+              std::function<void(const HttpResponsePtr&)>&& callback,
+              int sessionID);
 };
 
 } // namespace kamisado
@@ -0,0 +1,16 @@
+#include "MetricsController.h"
+#include "drogon/HttpResponse.h"
+#include "utils/Metrics.h"
+
+namespace kamisado {
+
+void MetricsController::metrics(
+    const HttpRequestPtr& /*req*/,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto resp = HttpResponse::newHttpResponse();
+  resp->setContentTypeString("text/plain; version=0.0.4");
+  resp->setBody(metrics::render());
+  callback(resp);
+}
+
+} // namespace kamisado
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+
+using namespace drogon;
+
+namespace kamisado {
+
+class MetricsController
+    : public drogon::HttpController<MetricsController> {
+public:
+  METHOD_LIST_BEGIN
+  ADD_METHOD_TO(MetricsController::metrics, "/metrics", Get,
+                "drogon::LocalHostFilter");
+  METHOD_LIST_END
+
+  /// Prometheus text format, see utils/Metrics.h. Only served to local
+  /// scrapers
+  void metrics(const HttpRequestPtr& req,
+               std::function<void(const HttpResponsePtr&)>&& callback);
+};
+
+} // namespace kamisado
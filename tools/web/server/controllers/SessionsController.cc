@@ -21,8 +21,45 @@ void SessionsController::create(
 
   SessionOptions options;
   options.analysisEnabled = (*body)["analysisEnabled"].asBool();
-  int sessionId =
-      app().getPlugin<SessionManagerPlugin>()->create(options);
+  if (body->isMember("evaluator")) {
+    auto evaluator = (*body)["evaluator"].asString();
+    if (evaluator != "handcrafted" && evaluator != "nnue") {
+      sendJsonError("Invalid evaluator", std::move(callback));
+      return;
+    }
+    options.useNetwork = evaluator == "nnue";
+  }
+  // "engine": { "side": "black", "level": 3 } plays against the server
+  if (body->isMember("engine")) {
+    const auto& engine = (*body)["engine"];
+    if (!engine.isObject()) {
+      sendJsonError("Invalid engine field", std::move(callback));
+      return;
+    }
+    auto side = engine["side"].asString();
+    if (side != "white" && side != "black") {
+      sendJsonError("Invalid engine side", std::move(callback));
+      return;
+    }
+    options.engineSide =
+        side == "white" ? Player::White : Player::Black;
+    auto levels = app().getPlugin<SessionManagerPlugin>()->engineLevels();
+    auto level  = engine.get("level", 1).asInt();
+    if (level < 1 || static_cast<size_t>(level) > levels) {
+      sendJsonError(fmt::format("Engine level must be 1-{}", levels),
+                    std::move(callback));
+      return;
+    }
+    options.engineLevel = static_cast<size_t>(level);
+  }
+  int sessionId{ 0 };
+  try {
+    sessionId = app().getPlugin<SessionManagerPlugin>()->create(options);
+  } catch (const SessionException& e) {
+    sendJsonError(e.what(), std::move(callback),
+                  drogon::k503ServiceUnavailable);
+    return;
+  }
   Json::Value respBody;
   respBody["sessionId"] = sessionId;
   callback(HttpResponse::newHttpJsonResponse(std::move(respBody)));
@@ -35,7 +72,7 @@ void SessionsController::join(
   try {
     auto body{ req->jsonObject() };
     auto* manager = app().getPlugin<SessionManagerPlugin>();
-    auto& session = manager->get(sessionID);
+    auto session  = manager->get(sessionID);
 
     Player sidePlayer{};
 
@@ -58,7 +95,11 @@ void SessionsController::join(
 
     Json::Value respBody;
     respBody["token"]           = token;
-    respBody["analysisEnabled"] = session.analysisEnabled();
+    respBody["analysisEnabled"] = session->analysisEnabled();
+    if (auto engineSide = session->engineSide()) {
+      respBody["engineSide"] =
+          *engineSide == Player::White ? "white" : "black";
+    }
     respBody["side"] = sidePlayer == Player::White ? "white" : "black";
     callback(HttpResponse::newHttpJsonResponse(std::move(respBody)));
   } catch (const SessionException& e) {
@@ -2,13 +2,177 @@
 #include "drogon/HttpAppFramework.h"
 #include "plugins/SessionManagerPlugin.h"
 #include "trantor/utils/Logger.h"
+#include "utils/BinaryProtocol.h"
+#include "utils/JsonWriter.h"
+#include "utils/Metrics.h"
+#include "utils/Utils.h"
+#include <json/reader.h>
+#include <memory>
 #include <stdexcept>
 
 namespace kamisado {
 
+namespace {
+
+struct Command {
+  binary::CommandType type;
+  Move move{};
+};
+
+auto parseBinaryCommand(std::string_view message) -> Command {
+  binary::Reader in{ message };
+  Command command{ .type = static_cast<binary::CommandType>(in.u8()) };
+  switch (command.type) {
+  case binary::CommandType::Move: {
+    auto move = binary::decodeMove(in.u16());
+    if (!move) {
+      throw binary::ProtocolError("Invalid move");
+    }
+    command.move = *move;
+    break;
+  }
+  case binary::CommandType::Resign:
+  case binary::CommandType::State:
+  case binary::CommandType::Leave:
+    break;
+  default:
+    throw binary::ProtocolError("Unknown command");
+  }
+  if (!in.done()) {
+    throw binary::ProtocolError("Trailing bytes in command");
+  }
+  return command;
+}
+
+/// {"type":"move","from":"a1","to":"a2"}, {"type":"resign"},
+/// {"type":"state"} or {"type":"leave"}
+auto parseJsonCommand(std::string_view message) -> Command {
+  thread_local const std::unique_ptr<Json::CharReader> reader{
+    Json::CharReaderBuilder{}.newCharReader()
+  };
+  Json::Value body;
+  if (!reader->parse(message.data(), message.data() + message.size(),
+                     &body, nullptr) ||
+      !body.isObject()) {
+    throw binary::ProtocolError("Malformed command");
+  }
+
+  auto type = body["type"].asString();
+  if (type == "resign") {
+    return { .type = binary::CommandType::Resign };
+  }
+  if (type == "state") {
+    return { .type = binary::CommandType::State };
+  }
+  if (type == "leave") {
+    return { .type = binary::CommandType::Leave };
+  }
+  if (type != "move") {
+    throw binary::ProtocolError("Unknown command");
+  }
+  auto from = fileRankToCoord(body["from"].asString());
+  auto to   = fileRankToCoord(body["to"].asString());
+  if (!from || !to) {
+    throw binary::ProtocolError("Invalid from/to");
+  }
+  return { .type = binary::CommandType::Move,
+           .move = Move{ .from = *from, .to = *to } };
+}
+
+void sendError(const WebSocketConnectionPtr& ws, Protocol protocol,
+               std::string_view message) {
+  if (protocol == Protocol::Binary) {
+    std::string frame;
+    binary::Writer out{ frame };
+    out.u8(static_cast<uint8_t>(binary::FrameType::Error));
+    out.bytes(message);
+    ws->send(frame, WebSocketMessageType::Binary);
+    return;
+  }
+  std::string buffer;
+  JsonWriter out{ buffer };
+  out.beginObject();
+  out.key("type").string("error");
+  out.key("payload").beginObject().key("message").string(message);
+  out.endObject().endObject();
+  ws->send(buffer);
+}
+
+} // namespace
+
 void WsSessionController::handleNewMessage(
     const WebSocketConnectionPtr& wsConnPtr, std::string&& message,
     const WebSocketMessageType& type) {
+  if (type != WebSocketMessageType::Text &&
+      type != WebSocketMessageType::Binary) {
+    return;
+  }
+  auto ctx = wsConnPtr->getContext<ConnContext>();
+  if (!ctx) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  Command command;
+  try {
+    command = type == WebSocketMessageType::Binary
+                  ? parseBinaryCommand(message)
+                  : parseJsonCommand(message);
+  } catch (const binary::ProtocolError& e) {
+    sendError(wsConnPtr, ctx->protocol, e.what());
+    return;
+  }
+
+  auto* manager = app().getPlugin<SessionManagerPlugin>();
+  if (command.type == binary::CommandType::Leave) {
+    // The seat is free, so later commands must not act for it
+    wsConnPtr->clearContext();
+    manager->leave(ctx->sessionID, ctx->side);
+    try {
+      manager->get(ctx->sessionID)->post([wsConnPtr](Session& session) {
+        session.unsubscribe(wsConnPtr);
+      });
+    } catch (const SessionException& e) {
+      LOG_WARN << "Error on leave: " << e.what();
+    }
+    wsConnPtr->shutdown();
+    return;
+  }
+
+  SessionPtr session;
+  try {
+    session = manager->get(ctx->sessionID);
+  } catch (const SessionException& e) {
+    sendError(wsConnPtr, ctx->protocol, e.what());
+    return;
+  }
+
+  // The connection was authenticated on upgrade, so commands skip the
+  // token lookup that HTTP moves pay for
+  session->post([wsConnPtr, ctx, command, start](Session& session) {
+    try {
+      switch (command.type) {
+      case binary::CommandType::Move:
+        if (ctx->side != session.playerToMove()) {
+          throw SessionException("Not your turn");
+        }
+        session.makeMove(command.move);
+        metrics::observe(metrics::Histogram::MoveLatency,
+                         std::chrono::steady_clock::now() - start);
+        break;
+      case binary::CommandType::Resign:
+        session.resign(ctx->side);
+        break;
+      case binary::CommandType::State:
+        session.sendState(wsConnPtr, ctx->protocol);
+        break;
+      case binary::CommandType::Leave:
+        break;
+      }
+    } catch (const SessionException& e) {
+      sendError(wsConnPtr, ctx->protocol, e.what());
+    }
+  });
 }
 
 void WsSessionController::handleNewConnection(
@@ -16,18 +180,22 @@ void WsSessionController::handleNewConnection(
   try {
     int sessionID = std::stoi(req->getParameter("sid"));
 
-    auto authRes = app().getPlugin<SessionManagerPlugin>()->auth(
-        req->getParameter("token"));
+    auto authRes = authIdentity(req);
     assert(authRes && "Auth filter failed");
     auto [authSessionID, authPlayer] = *authRes;
     if (authSessionID != sessionID) {
       return;
     }
+    auto protocol = req->getParameter("proto") == "binary"
+                        ? Protocol::Binary
+                        : Protocol::Json;
     wsConnPtr->setContext(
-        std::make_shared<ConnContext>(sessionID, authPlayer));
+        std::make_shared<ConnContext>(sessionID, authPlayer, protocol));
 
-    app().getPlugin<SessionManagerPlugin>()->get(sessionID).subscribe(
-        wsConnPtr);
+    app().getPlugin<SessionManagerPlugin>()->get(sessionID)->post(
+        [wsConnPtr, protocol](Session& session) {
+          session.subscribe(wsConnPtr, protocol);
+        });
     LOG_DEBUG << fmt::format("{} subscribed to session {}",
                              wsConnPtr->peerAddr().toIpPort(), sessionID);
   } catch (const std::invalid_argument& e) {
@@ -45,8 +213,11 @@ void WsSessionController::handleConnectionClosed(
       return;
     }
     auto* manager = app().getPlugin<SessionManagerPlugin>();
-    manager->get(ctx->sessionID).unsubscribe(wsConnPtr);
-    manager->leave(ctx->sessionID, ctx->side);
+    // The seat is kept for a reconnect, expiry or an explicit leave
+    // frees it
+    manager->get(ctx->sessionID)->post([wsConnPtr](Session& session) {
+      session.unsubscribe(wsConnPtr);
+    });
   } catch (const SessionException& e) {
     LOG_WARN << "Error on disconnect: " << e.what();
   }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "kamisado/Player.hpp"
+#include "plugins/SessionManagerPlugin.h"
 #include <drogon/WebSocketController.h>
 
 using namespace drogon;
@@ -10,6 +11,7 @@ namespace kamisado {
 struct ConnContext {
   int sessionID;
   Player side;
+  Protocol protocol{ Protocol::Json };
 };
 
 class WsSessionController
@@ -30,6 +30,7 @@ void AuthFilter::doFilter(const HttpRequestPtr& req, FilterCallback&& fcb,
 
   if (authRes) {
     // Passed
+    setAuthIdentity(req, *authRes);
     fccb();
     return;
   }
@@ -0,0 +1,585 @@
+/// Capacity test against a running server: holds N sessions with both
+/// sides joined over websockets, plays random legal moves at a fixed
+/// rate and reports move-to-delta latency and throughput. Finished
+/// games are replaced by new sessions.
+#include "kamisado/Config.hpp"
+#include "kamisado/Move.hpp"
+#include "kamisado/Player.hpp"
+#include "utils/BinaryProtocol.h"
+#include "utils/JsonWriter.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <drogon/HttpClient.h>
+#include <drogon/WebSocketClient.h>
+#include <fmt/format.h>
+#include <future>
+#include <iostream>
+#include <json/reader.h>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <trantor/net/EventLoopThreadPool.h>
+#include <trantor/utils/Logger.h>
+#include <vector>
+
+using namespace kamisado;
+using namespace drogon;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Args {
+  std::string host{ "http://127.0.0.1:80" };
+  size_t sessions{ 100 };
+  /// Moves per second per session, 0 answers every turn at once
+  double rate{ 2.0 };
+  std::chrono::seconds duration{ 30 };
+  unsigned threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  bool binary{ false };
+  uint64_t seed{ std::random_device{}() };
+};
+
+void usage() {
+  std::cerr << "Usage: kamisado-loadgen [--host URL] [--sessions N] "
+               "[--rate MOVES_PER_S] [--duration S] [--threads N] "
+               "[--proto json|binary] [--seed N]\n";
+}
+
+auto parseArgs(int argc, char** argv) -> std::optional<Args> {
+  Args args;
+  std::vector<std::string_view> argList(argv + 1, argv + argc);
+  for (size_t i = 0; i < argList.size(); i++) {
+    auto arg{ argList[i] };
+    if (i + 1 >= argList.size()) {
+      return std::nullopt;
+    }
+    std::string value{ argList[++i] };
+    if (arg == "--host") {
+      args.host = value;
+    } else if (arg == "--sessions") {
+      args.sessions = std::max(1UL, std::stoul(value));
+    } else if (arg == "--rate") {
+      args.rate = std::max(0.0, std::stod(value));
+    } else if (arg == "--duration") {
+      args.duration = std::chrono::seconds{ std::stoul(value) };
+    } else if (arg == "--threads") {
+      args.threads = std::max(1UL, std::stoul(value));
+    } else if (arg == "--proto") {
+      if (value != "json" && value != "binary") {
+        return std::nullopt;
+      }
+      args.binary = value == "binary";
+    } else if (arg == "--seed") {
+      args.seed = std::stoull(value);
+    } else {
+      return std::nullopt;
+    }
+  }
+  return args;
+}
+
+/// Results of the games on one loop. Latencies are only touched on the
+/// loop, the counters are also read by the progress report
+struct Recorder {
+  std::vector<Clock::duration> latencies;
+  std::atomic<uint64_t> connected{ 0 };
+  std::atomic<uint64_t> moves{ 0 };
+  std::atomic<uint64_t> games{ 0 };
+  std::atomic<uint64_t> errors{ 0 };
+};
+
+/// What a client knows after the latest state or delta message
+struct Position {
+  uint64_t seq{ 0 };
+  Player toMove{ Player::White };
+  bool terminal{ false };
+  std::vector<Move> legalMoves;
+};
+
+enum class Event : uint8_t {
+  None,
+  Position,
+  Ready,
+  Terminal,
+  Error
+};
+
+/// Inverse of squareName()
+auto parseSquare(std::string_view name) -> std::optional<Coord> {
+  if (name.size() != 2) {
+    return std::nullopt;
+  }
+  auto file = static_cast<size_t>(name[0] - 'a');
+  auto rank = static_cast<size_t>(name[1] - '1');
+  if (file >= config::BoardSize || rank >= config::BoardSize) {
+    return std::nullopt;
+  }
+  // Rows start from the top, ranks from the bottom
+  return Coord{ config::BoardSize - 1 - rank, file };
+}
+
+auto parseJson(std::string_view message, Position& position) -> Event {
+  thread_local const std::unique_ptr<Json::CharReader> reader{
+    Json::CharReaderBuilder{}.newCharReader()
+  };
+  Json::Value body;
+  if (!reader->parse(message.data(), message.data() + message.size(),
+                     &body, nullptr) ||
+      !body.isObject()) {
+    return Event::Error;
+  }
+  auto type = body["type"].asString();
+  if (type == "ready") {
+    return Event::Ready;
+  }
+  if (type == "terminal") {
+    return Event::Terminal;
+  }
+  if (type == "error") {
+    return Event::Error;
+  }
+  if (type != "state" && type != "delta") {
+    return Event::None;
+  }
+
+  const auto& payload = body["payload"];
+  position.seq        = payload["seq"].asUInt64();
+  position.toMove     = payload["turnSide"].asString() == "black"
+                            ? Player::Black
+                            : Player::White;
+  position.terminal =
+      payload["terminal"]["status"].asString() != "ongoing";
+  position.legalMoves.clear();
+  const auto& legal = payload["legalMovesMap"];
+  for (const auto& from : legal.getMemberNames()) {
+    for (const auto& to : legal[from]) {
+      auto fromCoord = parseSquare(from);
+      auto toCoord   = parseSquare(to.asString());
+      if (fromCoord && toCoord) {
+        position.legalMoves.push_back(
+            { .from = *fromCoord, .to = *toCoord });
+      }
+    }
+  }
+  return Event::Position;
+}
+
+auto parseBinary(std::string_view message, Position& position) -> Event {
+  binary::Reader in{ message };
+  auto type = static_cast<binary::FrameType>(in.u8());
+  switch (type) {
+  case binary::FrameType::State:
+  case binary::FrameType::Delta: {
+    position.seq = in.u32();
+    if (type == binary::FrameType::Delta) {
+      in.u16(); // Move
+      in.u8();  // Tower cell
+    }
+    position.toMove   = static_cast<Player>(in.u8());
+    position.terminal = in.u8() != 0;
+    in.u8(); // Forced colour
+    if (type == binary::FrameType::State) {
+      in.bytes(config::BoardSize * config::BoardSize);
+    }
+    position.legalMoves.resize(in.u8());
+    for (auto& move : position.legalMoves) {
+      move = Move::decode(in.u16());
+    }
+    return Event::Position;
+  }
+  case binary::FrameType::Ready:
+    return Event::Ready;
+  case binary::FrameType::Terminal:
+    return Event::Terminal;
+  case binary::FrameType::Error:
+    return Event::Error;
+  default:
+    return Event::None;
+  }
+}
+
+/// One session and both of its players, living on a single loop. A
+/// finished or failed game is replaced by a new session; callbacks of
+/// the previous one are told apart by the generation
+class Game : public std::enable_shared_from_this<Game> {
+public:
+  Game(const Args& args, trantor::EventLoop* loop, HttpClientPtr http,
+       Recorder& recorder, uint64_t seed)
+      : args_{ args },
+        loop_{ loop },
+        http_{ std::move(http) },
+        recorder_{ recorder },
+        rng_{ seed } {}
+
+  void start() {
+    ++generation_;
+    for (auto& seat : seats_) {
+      seat = Seat{ .side = seat.side };
+    }
+    create();
+  }
+
+  void stop() {
+    ++generation_;
+    for (auto& seat : seats_) {
+      if (seat.connected) {
+        recorder_.connected--;
+        seat.connected = false;
+      }
+      if (seat.ws) {
+        seat.ws->stop();
+        seat.ws.reset();
+      }
+    }
+  }
+
+private:
+  struct Seat {
+    Player side;
+    WebSocketClientPtr ws{};
+    std::string token{};
+    Position position{};
+    bool connected{ false };
+    bool ready{ false };
+    bool moveScheduled{ false };
+    // Sequence number of the delta answering our move, and when it was
+    // sent
+    std::optional<std::pair<uint64_t, Clock::time_point>> pending{};
+  };
+
+  /// Runs fn unless the game moved on to another session meanwhile
+  template <typename Fn>
+  auto guarded(Fn fn) {
+    return [weak = weak_from_this(), generation = generation_,
+            fn = std::move(fn)](auto&&... params) mutable {
+      auto self = weak.lock();
+      if (self && self->generation_ == generation) {
+        fn(*self, std::forward<decltype(params)>(params)...);
+      }
+    };
+  }
+
+  void fail() {
+    recorder_.errors++;
+    stop();
+    loop_->runAfter(1.0, guarded([](Game& game) {
+                      game.start();
+                    }));
+  }
+
+  void create() {
+    Json::Value body;
+    body["analysisEnabled"] = false;
+    auto req = HttpRequest::newHttpJsonRequest(body);
+    req->setMethod(Post);
+    req->setPath("/api/sessions");
+    http_->sendRequest(
+        req, guarded([](Game& game, ReqResult result,
+                        const HttpResponsePtr& resp) {
+          auto json =
+              result == ReqResult::Ok ? resp->jsonObject() : nullptr;
+          if (!json || !json->isMember("sessionId")) {
+            game.fail();
+            return;
+          }
+          game.sessionID_ = (*json)["sessionId"].asInt();
+          game.join(Player::White);
+        }));
+  }
+
+  void join(Player side) {
+    Json::Value body;
+    body["side"] = std::string{ playerName(side) };
+    auto req     = HttpRequest::newHttpJsonRequest(body);
+    req->setMethod(Post);
+    req->setPath(fmt::format("/api/sessions/{}/join", sessionID_));
+    http_->sendRequest(
+        req, guarded([side](Game& game, ReqResult result,
+                            const HttpResponsePtr& resp) {
+          auto json =
+              result == ReqResult::Ok ? resp->jsonObject() : nullptr;
+          if (!json || !json->isMember("token")) {
+            game.fail();
+            return;
+          }
+          game.seat(side).token = (*json)["token"].asString();
+          if (side == Player::White) {
+            game.join(Player::Black);
+          } else {
+            game.connect(game.seat(Player::White));
+            game.connect(game.seat(Player::Black));
+          }
+        }));
+  }
+
+  void connect(Seat& seat) {
+    auto side = seat.side;
+    seat.ws   = WebSocketClient::newWebSocketClient(args_.host, loop_);
+    seat.ws->setMessageHandler(
+        guarded([side](Game& game, std::string&& message,
+                       const WebSocketClientPtr& /*ws*/,
+                       const WebSocketMessageType& /*type*/) {
+          game.onMessage(game.seat(side), message);
+        }));
+    seat.ws->setConnectionClosedHandler(
+        guarded([](Game& game, const WebSocketClientPtr& /*ws*/) {
+          game.fail();
+        }));
+
+    auto req = HttpRequest::newHttpRequest();
+    req->setPath("/ws/sessions");
+    req->setParameter("sid", std::to_string(sessionID_));
+    if (args_.binary) {
+      req->setParameter("proto", "binary");
+    }
+    req->addHeader("Authorization", "Bearer " + seat.token);
+    seat.ws->connectToServer(
+        req, guarded([side](Game& game, ReqResult result,
+                            const HttpResponsePtr& /*resp*/,
+                            const WebSocketClientPtr& /*ws*/) {
+          if (result != ReqResult::Ok) {
+            game.fail();
+            return;
+          }
+          game.seat(side).connected = true;
+          game.recorder_.connected++;
+        }));
+  }
+
+  auto seat(Player side) -> Seat& {
+    return seats_[static_cast<size_t>(side)];
+  }
+
+  void onMessage(Seat& seat, std::string_view message) {
+    Event event{ Event::None };
+    try {
+      event = args_.binary ? parseBinary(message, seat.position)
+                           : parseJson(message, seat.position);
+    } catch (const binary::ProtocolError&) {
+      event = Event::Error;
+    }
+
+    switch (event) {
+    case Event::Ready:
+      seat.ready = true;
+      break;
+    case Event::Position:
+      if (seat.pending && seat.position.seq >= seat.pending->first) {
+        recorder_.latencies.push_back(Clock::now() -
+                                      seat.pending->second);
+        recorder_.moves++;
+        seat.pending.reset();
+      }
+      break;
+    case Event::Terminal:
+      seat.position.terminal = true;
+      break;
+    case Event::Error:
+      // Resynchronise, the snapshot schedules the next move
+      recorder_.errors++;
+      seat.pending.reset();
+      requestState(seat);
+      return;
+    case Event::None:
+      return;
+    }
+
+    if (seat.position.terminal) {
+      recorder_.games++;
+      stop();
+      start();
+      return;
+    }
+    scheduleMove(seat);
+  }
+
+  void scheduleMove(Seat& seat) {
+    if (!seat.ready || seat.moveScheduled || seat.pending ||
+        seat.position.toMove != seat.side) {
+      return;
+    }
+    seat.moveScheduled = true;
+    auto play          = guarded([side = seat.side](Game& game) {
+      auto& seat         = game.seat(side);
+      seat.moveScheduled = false;
+      game.sendMove(seat);
+    });
+    if (args_.rate > 0) {
+      loop_->runAfter(1.0 / args_.rate, std::move(play));
+    } else {
+      loop_->queueInLoop(std::move(play));
+    }
+  }
+
+  void sendMove(Seat& seat) {
+    const auto& position = seat.position;
+    // A pass may have handed the turn over meanwhile
+    if (position.toMove != seat.side || position.terminal ||
+        position.legalMoves.empty() || !seat.ws) {
+      return;
+    }
+    std::uniform_int_distribution<size_t> pick{
+      0, position.legalMoves.size() - 1
+    };
+    auto move    = position.legalMoves[pick(rng_)];
+    seat.pending = { position.seq + 1, Clock::now() };
+
+    std::string message;
+    if (args_.binary) {
+      binary::Writer out{ message };
+      out.u8(static_cast<uint8_t>(binary::CommandType::Move));
+      out.u16(move.encode());
+      seat.ws->getConnection()->send(message,
+                                     WebSocketMessageType::Binary);
+    } else {
+      JsonWriter out{ message };
+      out.beginObject();
+      out.key("type").string("move");
+      out.key("from").string(squareName(move.from));
+      out.key("to").string(squareName(move.to));
+      out.endObject();
+      seat.ws->getConnection()->send(out.str());
+    }
+  }
+
+  void requestState(Seat& seat) {
+    if (!seat.ws) {
+      return;
+    }
+    if (args_.binary) {
+      std::string frame(1, static_cast<char>(binary::CommandType::State));
+      seat.ws->getConnection()->send(frame, WebSocketMessageType::Binary);
+    } else {
+      seat.ws->getConnection()->send(R"({"type":"state"})");
+    }
+  }
+
+  const Args& args_;
+  trantor::EventLoop* loop_;
+  HttpClientPtr http_;
+  Recorder& recorder_;
+  std::mt19937_64 rng_;
+  uint64_t generation_{ 0 };
+  int sessionID_{ 0 };
+  std::array<Seat, 2> seats_{ Seat{ .side = Player::White },
+                              Seat{ .side = Player::Black } };
+};
+
+auto percentile(const std::vector<Clock::duration>& sorted, double p)
+    -> double {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  auto rank = static_cast<size_t>(
+      std::ceil(p * static_cast<double>(sorted.size())));
+  auto index = std::clamp<size_t>(rank, 1, sorted.size()) - 1;
+  return std::chrono::duration<double, std::milli>(sorted[index]).count();
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+  std::optional<Args> args;
+  try {
+    args = parseArgs(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    args.reset();
+  }
+  if (!args) {
+    usage();
+    return 1;
+  }
+  trantor::Logger::setLogLevel(trantor::Logger::kWarn);
+
+  std::cout << fmt::format(
+      "{} sessions against {} over {} websockets, {} moves/s per "
+      "session for {} s on {} threads\n",
+      args->sessions, args->host, args->binary ? "binary" : "JSON",
+      args->rate, args->duration.count(), args->threads);
+
+  trantor::EventLoopThreadPool pool{ args->threads, "loadgen" };
+  pool.start();
+  std::vector<Recorder> recorders(args->threads);
+  // Each list is only touched on its loop once started
+  std::vector<std::vector<std::shared_ptr<Game>>> games(args->threads);
+  for (size_t t = 0; t < args->threads; t++) {
+    auto* loop = pool.getLoop(t);
+    auto http  = HttpClient::newHttpClient(args->host, loop);
+    for (size_t i = t; i < args->sessions; i += args->threads) {
+      games[t].push_back(std::make_shared<Game>(
+          *args, loop, http, recorders[t], args->seed + i));
+    }
+    loop->runInLoop([&list = games[t]] {
+      for (auto& game : list) {
+        game->start();
+      }
+    });
+  }
+
+  auto start    = Clock::now();
+  auto deadline = start + args->duration;
+  while (Clock::now() < deadline) {
+    std::this_thread::sleep_for(
+        std::min<Clock::duration>(std::chrono::seconds{ 5 },
+                                  deadline - Clock::now()));
+    uint64_t connected{ 0 };
+    uint64_t moves{ 0 };
+    for (const auto& recorder : recorders) {
+      connected += recorder.connected;
+      moves += recorder.moves;
+    }
+    std::cout << fmt::format("{:.0f} s: {}/{} connected, {} moves\n",
+                             std::chrono::duration<double>(Clock::now() -
+                                                           start)
+                                 .count(),
+                             connected, args->sessions * 2, moves);
+  }
+
+  for (size_t t = 0; t < args->threads; t++) {
+    std::promise<void> stopped;
+    pool.getLoop(t)->runInLoop([&] {
+      for (auto& game : games[t]) {
+        game->stop();
+      }
+      games[t].clear();
+      stopped.set_value();
+    });
+    stopped.get_future().wait();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+
+  std::vector<Clock::duration> latencies;
+  uint64_t finished{ 0 };
+  uint64_t errors{ 0 };
+  for (auto& recorder : recorders) {
+    latencies.insert(latencies.end(), recorder.latencies.begin(),
+                     recorder.latencies.end());
+    finished += recorder.games;
+    errors += recorder.errors;
+  }
+  std::ranges::sort(latencies);
+
+  std::cout << fmt::format(
+      "{} moves in {:.1f} s, {:.1f} moves/s, {} games finished, {} "
+      "errors\n",
+      latencies.size(), elapsed.count(),
+      static_cast<double>(latencies.size()) / elapsed.count(), finished,
+      errors);
+  std::cout << fmt::format(
+      "Move to delta: p50 {:.3f} ms, p99 {:.3f} ms, p999 {:.3f} ms\n",
+      percentile(latencies, 0.5), percentile(latencies, 0.99),
+      percentile(latencies, 0.999));
+
+  for (size_t t = 0; t < args->threads; t++) {
+    pool.getLoop(t)->quit();
+  }
+  pool.wait();
+  return 0;
+}
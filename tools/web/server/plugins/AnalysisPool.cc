@@ -0,0 +1,272 @@
+/**
+ *
+ *  AnalysisPool.cc
+ *
+ */
+
+#include "AnalysisPool.h"
+#include "kamisado/Evaluator.hpp"
+#include "kamisado/MoveGen.hpp"
+#include "utils/Metrics.h"
+#include <algorithm>
+
+namespace kamisado {
+
+AnalysisPool::AnalysisPool(Options options)
+    : options_{ std::move(options) } {
+  workers_.reserve(options_.threads);
+  for (size_t i = 0; i < options_.threads; i++) {
+    auto worker    = std::make_unique<Worker>();
+    auto* raw      = worker.get();
+    worker->thread = std::jthread([this, raw] {
+      work(*raw);
+    });
+    workers_.push_back(std::move(worker));
+  }
+}
+
+AnalysisPool::~AnalysisPool() {
+  stop();
+}
+
+void AnalysisPool::stop() {
+  {
+    std::scoped_lock lock{ mutex_ };
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+    for (auto& worker : workers_) {
+      worker->stop.request_stop();
+    }
+  }
+  jobReady_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+auto AnalysisPool::cached(const GameState& state, bool useNetwork) const
+    -> std::optional<SearchEngine::Result> {
+  if (!options_.cache) {
+    return std::nullopt;
+  }
+  auto hit =
+      options_.cache->find(ResultCache::key(state.hash(), useNetwork));
+  if (!hit || !hit->bestMove) {
+    return std::nullopt;
+  }
+  // Guard against key collisions
+  auto moves = MoveGen::legalMoves(state);
+  if (std::ranges::find(moves, *hit->bestMove) == moves.end()) {
+    return std::nullopt;
+  }
+  return hit;
+}
+
+auto AnalysisPool::isFinal(const SearchEngine::Result& result) -> bool {
+  return Evaluator::isMateScore(result.score) ||
+         result.depth >= config::MaxDepth;
+}
+
+void AnalysisPool::submit(int sessionID, const GameState& state,
+                          bool useNetwork, Callback callback) {
+  auto hit = cached(state, useNetwork);
+  if (hit) {
+    callback(*hit, isFinal(*hit));
+  }
+
+  std::scoped_lock lock{ mutex_ };
+  auto [it, inserted] =
+      jobs_.try_emplace(sessionID, Job{ .state = state });
+  auto& job           = it->second;
+  if (!inserted) {
+    job.state = state;
+  }
+  job.dropped       = false;
+  job.useNetwork    = useNetwork;
+  job.callback      = std::move(callback);
+  job.best          = hit;
+  job.generation    = ++nextGeneration_;
+  job.reportedDepth = hit ? hit->depth : 0;
+  job.nodes         = 0;
+  job.sliceNodes    = options_.sliceNodes;
+
+  if (job.running) {
+    // Stale slice, its worker requeues the job once it returns
+    stopSlice(sessionID);
+  }
+  if (hit && isFinal(*hit)) {
+    // Nothing deeper to find, the worker of a running slice erases it
+    if (job.running) {
+      job.dropped  = true;
+      job.callback = nullptr;
+    } else {
+      jobs_.erase(it);
+    }
+  } else if (!job.running && !job.queued) {
+    enqueue(sessionID, job);
+  }
+}
+
+void AnalysisPool::cancel(int sessionID) {
+  std::scoped_lock lock{ mutex_ };
+  auto it = jobs_.find(sessionID);
+  if (it == jobs_.end()) {
+    return;
+  }
+  if (!it->second.running) {
+    jobs_.erase(it);
+    return;
+  }
+  // Erasing it would let a new submit search the session twice
+  it->second.dropped  = true;
+  it->second.callback = nullptr;
+  stopSlice(sessionID);
+}
+
+void AnalysisPool::stopSlice(int sessionID) {
+  for (auto& worker : workers_) {
+    if (worker->sessionID == sessionID) {
+      worker->stop.request_stop();
+    }
+  }
+}
+
+void AnalysisPool::setWatched(int sessionID, bool watched) {
+  std::scoped_lock lock{ mutex_ };
+  auto it = jobs_.find(sessionID);
+  if (it == jobs_.end() || it->second.watched == watched) {
+    return;
+  }
+  it->second.watched = watched;
+  if (it->second.queued) {
+    // The entry in the other queue turns stale, see popJob
+    it->second.queued = false;
+    enqueue(sessionID, it->second);
+  }
+}
+
+void AnalysisPool::enqueue(int sessionID, Job& job) {
+  job.queued = true;
+  (job.watched ? watchedQueue_ : backgroundQueue_).push_back(sessionID);
+  jobReady_.notify_one();
+}
+
+auto AnalysisPool::popJob() -> std::optional<int> {
+  for (auto* queue : { &watchedQueue_, &backgroundQueue_ }) {
+    while (!queue->empty()) {
+      int id = queue->front();
+      queue->pop_front();
+      auto it = jobs_.find(id);
+      // Entries of cancelled or re-prioritized jobs are skipped
+      if (it != jobs_.end() && it->second.queued &&
+          it->second.watched == (queue == &watchedQueue_)) {
+        it->second.queued = false;
+        return id;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+auto AnalysisPool::engineFor(Worker& worker, bool useNetwork)
+    -> SearchEngine& {
+  auto& engine = worker.engines[useNetwork ? 1 : 0];
+  if (!table_) {
+    table_ = std::make_shared<TranspositionTable>(
+        TranspositionTable::sizeForBytes(options_.tableBytes));
+  }
+  if (!engine) {
+    engine = std::make_unique<SearchEngine>(table_);
+    engine->setNetwork(useNetwork ? options_.network : nullptr);
+    engine->setBook(options_.book);
+  }
+  return *engine;
+}
+
+void AnalysisPool::work(Worker& worker) {
+  std::unique_lock lock{ mutex_ };
+  while (true) {
+    std::optional<int> id;
+    jobReady_.wait(lock, [&] {
+      return stopping_ || (id = popJob()).has_value();
+    });
+    if (stopping_) {
+      return;
+    }
+
+    auto& job        = jobs_.at(*id);
+    job.running      = true;
+    auto state       = job.state;
+    auto generation  = job.generation;
+    auto sliceNodes  = job.sliceNodes;
+    auto best        = job.best;
+    auto useNetwork  = job.useNetwork;
+    auto& engine     = engineFor(worker, job.useNetwork);
+    worker.sessionID = id;
+    worker.stop      = {};
+    SearchEngine::Limits limits{ .maxNodes = sliceNodes,
+                                 .stop     = worker.stop.get_token() };
+    lock.unlock();
+
+    metrics::add(metrics::Gauge::RunningSearches, 1);
+    auto result = best ? engine.search(state, limits, *best)
+                       : engine.search(state, limits);
+    auto nodes  = engine.nodes();
+    metrics::add(metrics::Gauge::RunningSearches, -1);
+    metrics::recordSearch(nodes, engine.tableProbes(),
+                          engine.tableHits());
+    if (options_.cache && result.bestMove &&
+        (!best || result.depth > best->depth)) {
+      // Valid for the searched position even if the job moved on
+      options_.cache->store(ResultCache::key(state.hash(), useNetwork),
+                            result);
+    }
+
+    lock.lock();
+    worker.sessionID.reset();
+    Callback callback;
+    bool final{ false };
+    auto it = jobs_.find(*id);
+    if (it != jobs_.end()) {
+      auto& current   = it->second;
+      current.running = false;
+      if (current.dropped) {
+        jobs_.erase(it);
+      } else if (current.generation != generation) {
+        enqueue(*id, current);
+      } else {
+        current.nodes += nodes;
+        bool deeper =
+            result.bestMove && result.depth > current.reportedDepth;
+        if (deeper) {
+          current.reportedDepth = result.depth;
+          current.best          = result;
+          callback              = current.callback;
+        } else {
+          current.sliceNodes =
+              std::min(current.sliceNodes * 2, options_.maxNodes);
+        }
+
+        // Book hits search no nodes and are final
+        bool done = nodes == 0 || !result.bestMove || isFinal(result) ||
+                    current.nodes >= options_.maxNodes;
+        final = done;
+        if (done) {
+          jobs_.erase(it);
+        } else {
+          enqueue(*id, current);
+        }
+      }
+    }
+
+    if (callback) {
+      lock.unlock();
+      callback(result, final);
+      lock.lock();
+    }
+  }
+}
+
+} // namespace kamisado
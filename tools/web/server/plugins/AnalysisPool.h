@@ -0,0 +1,124 @@
+/**
+ *
+ *  AnalysisPool.h
+ *
+ */
+
+#pragma once
+
+#include "ResultCache.h"
+#include "kamisado/GameState.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
+#include "kamisado/SearchEngine.hpp"
+#include "kamisado/TranspositionTable.hpp"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace kamisado {
+
+/// Fixed set of engine threads shared by all sessions. Every session has
+/// at most one job; workers search it in node-limited slices and requeue
+/// it, so CPU use scales with cores rather than with session count.
+/// Sessions with active viewers are served first.
+class AnalysisPool {
+public:
+  /// Receives each deeper result, final is set on the last one
+  using Callback =
+      std::function<void(const SearchEngine::Result&, bool final)>;
+
+  struct Options {
+    size_t threads{ std::max(1U, std::thread::hardware_concurrency()) };
+    /// Nodes per slice, doubled for a job whose slice found no new depth
+    uint64_t sliceNodes{ 200'000 };
+    /// Total nodes spent on one position before the job is dropped
+    uint64_t maxNodes{ 200'000'000 };
+    /// Budget for the table shared by all workers, allocated when the
+    /// first job runs
+    size_t tableBytes{ size_t{ 256 } << 20U };
+    std::shared_ptr<const nnue::Network> network;
+    std::shared_ptr<const OpeningBook> book;
+    /// Optional, serves known positions instantly and lets searches
+    /// resume above the cached depth
+    std::shared_ptr<ResultCache> cache{};
+  };
+
+  explicit AnalysisPool(Options options);
+  ~AnalysisPool();
+
+  AnalysisPool(const AnalysisPool&)                    = delete;
+  auto operator=(const AnalysisPool&) -> AnalysisPool& = delete;
+
+  /// Replaces the session's previous job. The callback is invoked from a
+  /// worker thread each time a deeper result is found, or right away
+  /// with a cached one
+  void submit(int sessionID, const GameState& state, bool useNetwork,
+              Callback callback);
+  /// Drops the session's job and stops a running slice without waiting
+  /// for it. The callback may still be invoked once by a slice that
+  /// already returned
+  void cancel(int sessionID);
+  void setWatched(int sessionID, bool watched);
+  void stop();
+
+private:
+  struct Job {
+    GameState state;
+    bool useNetwork{ false };
+    Callback callback{};
+    // Deepest result so far, slices resume above it
+    std::optional<SearchEngine::Result> best{};
+    uint64_t generation{ 0 };
+    int reportedDepth{ 0 };
+    uint64_t nodes{ 0 };
+    uint64_t sliceNodes{ 0 };
+    bool watched{ false };
+    bool queued{ false };
+    bool running{ false };
+    // Cancelled or answered while running, erased once its slice
+    // returns
+    bool dropped{ false };
+  };
+
+  struct Worker {
+    std::array<std::unique_ptr<SearchEngine>, 2> engines;
+    // Replaced for every slice, a stale job stops its running slice
+    std::stop_source stop;
+    std::optional<int> sessionID;
+    std::jthread thread;
+  };
+
+  void work(Worker& worker);
+  auto engineFor(Worker& worker, bool useNetwork) -> SearchEngine&;
+  auto popJob() -> std::optional<int>;
+  void enqueue(int sessionID, Job& job);
+  void stopSlice(int sessionID);
+  /// A cached result whose best move is legal in state
+  auto cached(const GameState& state, bool useNetwork) const
+      -> std::optional<SearchEngine::Result>;
+  static auto isFinal(const SearchEngine::Result& result) -> bool;
+
+private:
+  Options options_;
+  std::shared_ptr<TranspositionTable> table_;
+  std::mutex mutex_;
+  std::condition_variable jobReady_;
+  std::unordered_map<int, Job> jobs_;
+  std::deque<int> watchedQueue_;
+  std::deque<int> backgroundQueue_;
+  uint64_t nextGeneration_{ 0 };
+  bool stopping_{ false };
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} // namespace kamisado
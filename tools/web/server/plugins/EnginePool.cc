@@ -0,0 +1,150 @@
+/**
+ *
+ *  EnginePool.cc
+ *
+ */
+
+#include "EnginePool.h"
+#include "utils/Metrics.h"
+#include <utility>
+
+namespace kamisado {
+
+EnginePool::EnginePool(Options options)
+    : options_{ std::move(options) } {
+  workers_.reserve(options_.threads);
+  for (size_t i = 0; i < options_.threads; i++) {
+    auto worker    = std::make_unique<Worker>();
+    auto* raw      = worker.get();
+    worker->thread = std::jthread([this, raw] {
+      work(*raw);
+    });
+    workers_.push_back(std::move(worker));
+  }
+}
+
+EnginePool::~EnginePool() {
+  stop();
+}
+
+void EnginePool::stop() {
+  std::deque<Request> left;
+  {
+    std::scoped_lock lock{ mutex_ };
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+    left      = std::exchange(queue_, {});
+    for (auto& worker : workers_) {
+      if (worker->engine) {
+        worker->engine->stopSearch();
+      }
+    }
+  }
+  requestReady_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+  // Waiters such as HTTP requests must still get an answer
+  for (auto& request : left) {
+    if (request.dropped) {
+      request.dropped();
+    }
+  }
+}
+
+void EnginePool::submit(int sessionID, const GameState& state,
+                        bool useNetwork, SearchEngine::Limits limits,
+                        Callback callback, DropCallback dropped) {
+  {
+    std::scoped_lock lock{ mutex_ };
+    if (!stopping_) {
+      queue_.push_back(Request{ .sessionID  = sessionID,
+                               .state      = state,
+                               .useNetwork = useNetwork,
+                               .limits     = limits,
+                               .callback   = std::move(callback),
+                               .dropped    = std::move(dropped) });
+      requestReady_.notify_one();
+      return;
+    }
+  }
+  if (dropped) {
+    dropped();
+  }
+}
+
+void EnginePool::cancel(int sessionID) {
+  std::scoped_lock lock{ mutex_ };
+  std::erase_if(queue_, [&](const Request& request) {
+    return request.sessionID == sessionID;
+  });
+  for (auto& worker : workers_) {
+    if (worker->sessionID == sessionID && worker->engine) {
+      worker->cancelled = true;
+      worker->engine->stopSearch();
+    }
+  }
+}
+
+auto EnginePool::engineFor(Worker& worker, bool useNetwork)
+    -> SearchEngine& {
+  auto& engine = worker.engines[useNetwork ? 1 : 0];
+  if (!table_) {
+    table_ = std::make_shared<TranspositionTable>(
+        TranspositionTable::sizeForBytes(options_.tableBytes));
+  }
+  if (!engine) {
+    engine = std::make_unique<SearchEngine>(table_);
+    engine->setNetwork(useNetwork ? options_.network : nullptr);
+    engine->setBook(options_.book);
+  }
+  return *engine;
+}
+
+void EnginePool::work(Worker& worker) {
+  std::unique_lock lock{ mutex_ };
+  while (true) {
+    requestReady_.wait(lock, [&] {
+      return stopping_ || !queue_.empty();
+    });
+    if (stopping_) {
+      return;
+    }
+
+    auto request = std::move(queue_.front());
+    queue_.pop_front();
+    auto& engine     = engineFor(worker, request.useNetwork);
+    worker.sessionID = request.sessionID;
+    worker.engine    = &engine;
+    worker.cancelled = false;
+    lock.unlock();
+
+    metrics::add(metrics::Gauge::RunningSearches, 1);
+    auto result = engine.search(request.state, request.limits);
+    metrics::add(metrics::Gauge::RunningSearches, -1);
+    metrics::recordSearch(engine.nodes(), engine.tableProbes(),
+                          engine.tableHits());
+
+    lock.lock();
+    worker.engine = nullptr;
+    worker.sessionID.reset();
+    if (worker.cancelled) {
+      continue;
+    }
+    if (stopping_) {
+      // The search was cut short, its result is not worth sending
+      lock.unlock();
+      if (request.dropped) {
+        request.dropped();
+      }
+      return;
+    }
+    lock.unlock();
+    request.callback(result);
+    lock.lock();
+  }
+}
+
+} // namespace kamisado
@@ -0,0 +1,94 @@
+/**
+ *
+ *  EnginePool.h
+ *
+ */
+
+#pragma once
+
+#include "kamisado/GameState.hpp"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
+#include "kamisado/SearchEngine.hpp"
+#include "kamisado/TranspositionTable.hpp"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace kamisado {
+
+/// Fixed set of threads choosing moves for engine opponents. Every
+/// request searches with the budget of its strength level, so the CPU
+/// cost of a bot move is known up front, and bot games beyond the
+/// thread count queue instead of oversubscribing cores.
+class EnginePool {
+public:
+  using Callback = std::function<void(const SearchEngine::Result&)>;
+  using DropCallback = std::function<void()>;
+
+  struct Options {
+    size_t threads{ 1 };
+    /// Budget for the table shared by all workers, allocated when the
+    /// first request runs
+    size_t tableBytes{ size_t{ 64 } << 20U };
+    std::shared_ptr<const nnue::Network> network;
+    std::shared_ptr<const OpeningBook> book;
+  };
+
+  explicit EnginePool(Options options);
+  ~EnginePool();
+
+  EnginePool(const EnginePool&)                    = delete;
+  auto operator=(const EnginePool&) -> EnginePool& = delete;
+
+  /// Queues a search, requests are served in order. The callback is
+  /// invoked once from a worker thread, or dropped if the pool stops
+  /// first
+  void submit(int sessionID, const GameState& state, bool useNetwork,
+              SearchEngine::Limits limits, Callback callback,
+              DropCallback dropped = {});
+  /// Drops the session's requests and stops a running one without
+  /// invoking either callback
+  void cancel(int sessionID);
+  /// Stops the workers, invoking dropped for every request left
+  void stop();
+
+private:
+  struct Request {
+    int sessionID{ 0 };
+    GameState state;
+    bool useNetwork{ false };
+    SearchEngine::Limits limits;
+    Callback callback{};
+    DropCallback dropped{};
+  };
+
+  struct Worker {
+    std::array<std::unique_ptr<SearchEngine>, 2> engines;
+    SearchEngine* engine{ nullptr };
+    std::optional<int> sessionID;
+    bool cancelled{ false };
+    std::jthread thread;
+  };
+
+  void work(Worker& worker);
+  auto engineFor(Worker& worker, bool useNetwork) -> SearchEngine&;
+
+private:
+  Options options_;
+  std::shared_ptr<TranspositionTable> table_;
+  std::mutex mutex_;
+  std::condition_variable requestReady_;
+  std::deque<Request> queue_;
+  bool stopping_{ false };
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} // namespace kamisado
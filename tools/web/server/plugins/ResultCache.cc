@@ -0,0 +1,57 @@
+/**
+ *
+ *  ResultCache.cc
+ *
+ */
+
+#include "ResultCache.h"
+#include <algorithm>
+
+namespace kamisado {
+
+ResultCache::ResultCache(size_t capacity)
+    : shardCapacity_{ std::max<size_t>(capacity / s_Shards, 1) } {
+}
+
+auto ResultCache::key(uint64_t hash, bool useNetwork) -> uint64_t {
+  return hash ^ (useNetwork ? s_NetworkKeySalt : 0);
+}
+
+auto ResultCache::shardFor(uint64_t key) -> Shard& {
+  // Low bits index the tables, the high ones spread shards
+  return shards_[(key >> 60U) % s_Shards];
+}
+
+auto ResultCache::find(uint64_t key)
+    -> std::optional<SearchEngine::Result> {
+  auto& shard = shardFor(key);
+  std::scoped_lock lock{ shard.mutex };
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return std::nullopt;
+  }
+  shard.order.splice(shard.order.begin(), shard.order, it->second);
+  return it->second->second;
+}
+
+void ResultCache::store(uint64_t key, const SearchEngine::Result& result) {
+  auto& shard = shardFor(key);
+  std::scoped_lock lock{ shard.mutex };
+  if (auto it = shard.index.find(key); it != shard.index.end()) {
+    auto& cached = it->second->second;
+    if (result.depth > cached.depth) {
+      cached = result;
+    }
+    shard.order.splice(shard.order.begin(), shard.order, it->second);
+    return;
+  }
+
+  if (shard.order.size() >= shardCapacity_) {
+    shard.index.erase(shard.order.back().first);
+    shard.order.pop_back();
+  }
+  shard.order.emplace_front(key, result);
+  shard.index.emplace(key, shard.order.begin());
+}
+
+} // namespace kamisado
@@ -0,0 +1,54 @@
+/**
+ *
+ *  ResultCache.h
+ *
+ */
+
+#pragma once
+
+#include "kamisado/SearchEngine.hpp"
+#include <array>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace kamisado {
+
+/// Process-wide LRU of the deepest completed analysis per position, so
+/// sessions passing through the same position share the work. Split into
+/// independently locked shards, as every analysis worker writes to it
+class ResultCache {
+public:
+  explicit ResultCache(size_t capacity);
+
+  /// NNUE and handcrafted results are kept apart
+  static auto key(uint64_t hash, bool useNetwork) -> uint64_t;
+
+  /// Marks the entry as recently used
+  auto find(uint64_t key) -> std::optional<SearchEngine::Result>;
+  /// Keeps the deeper of the cached and the given result
+  void store(uint64_t key, const SearchEngine::Result& result);
+
+private:
+  using Order = std::list<std::pair<uint64_t, SearchEngine::Result>>;
+
+  struct Shard {
+    std::mutex mutex;
+    // Most recently used first
+    Order order;
+    std::unordered_map<uint64_t, Order::iterator> index;
+  };
+
+  auto shardFor(uint64_t key) -> Shard&;
+
+private:
+  static constexpr size_t s_Shards = 16;
+  static constexpr uint64_t s_NetworkKeySalt{ 0x9E3779B97F4A7C15ULL };
+
+  size_t shardCapacity_;
+  std::array<Shard, s_Shards> shards_;
+};
+
+} // namespace kamisado
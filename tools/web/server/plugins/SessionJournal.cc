@@ -0,0 +1,569 @@
+/**
+ *
+ *  SessionJournal.cc
+ *
+ */
+
+#include "SessionJournal.h"
+#include "kamisado/MappedFile.hpp"
+#include "trantor/utils/Logger.h"
+#include "utils/BinaryProtocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace kamisado {
+
+namespace {
+
+constexpr uint32_t s_JournalMagic{ 0x314A534B };  // "KSJ1"
+constexpr uint32_t s_SnapshotMagic{ 0x3153534B }; // "KSS1"
+constexpr std::string_view s_JournalPrefix{ "journal." };
+constexpr std::string_view s_SnapshotName{ "snapshot" };
+// u16 length and u32 checksum
+constexpr size_t s_FrameHeader{ 6 };
+
+auto checksum(std::string_view bytes) -> uint32_t {
+  uint32_t hash{ 0x811C9DC5U };
+  for (auto b : bytes) {
+    hash ^= static_cast<uint8_t>(b);
+    hash *= 0x01000193U;
+  }
+  return hash;
+}
+
+auto journalNumber(const std::filesystem::path& path)
+    -> std::optional<uint64_t> {
+  auto name = path.filename().string();
+  if (!name.starts_with(s_JournalPrefix)) {
+    return std::nullopt;
+  }
+  std::string_view digits{ name };
+  digits.remove_prefix(s_JournalPrefix.size());
+  uint64_t number{ 0 };
+  const auto* last = digits.data() + digits.size();
+  auto [end, ec]   = std::from_chars(digits.data(), last, number);
+  if (ec != std::errc{} || end != last) {
+    return std::nullopt;
+  }
+  return number;
+}
+
+auto journals(const std::filesystem::path& dir)
+    -> std::vector<std::pair<uint64_t, std::filesystem::path>> {
+  std::vector<std::pair<uint64_t, std::filesystem::path>> out;
+  for (const auto& entry : std::filesystem::directory_iterator{ dir }) {
+    if (auto number = journalNumber(entry.path())) {
+      out.emplace_back(*number, entry.path());
+    }
+  }
+  std::ranges::sort(out);
+  return out;
+}
+
+auto encodePlayer(std::optional<Player> player) -> uint8_t {
+  return player ? static_cast<uint8_t>(*player) : binary::s_None;
+}
+
+auto decodePlayer(uint8_t value) -> std::optional<Player> {
+  if (value == binary::s_None) {
+    return std::nullopt;
+  }
+  if (value > static_cast<uint8_t>(Player::Black)) {
+    throw binary::ProtocolError("Invalid player");
+  }
+  return static_cast<Player>(value);
+}
+
+enum class RecordType : uint8_t {
+  Create = 1,
+  Join   = 2,
+  Leave  = 3,
+  Move   = 4,
+  Resign = 5,
+  Expire = 6,
+};
+
+// Record bodies start with their type and session ID
+
+auto header(RecordType type, int id) -> std::string {
+  std::string body;
+  binary::Writer out{ body };
+  out.u8(static_cast<uint8_t>(type));
+  out.u32(static_cast<uint32_t>(id));
+  return body;
+}
+
+auto createRecord(const PersistedSession& session) -> std::string {
+  auto body = header(RecordType::Create, session.id);
+  binary::Writer out{ body };
+  out.u8(static_cast<uint8_t>((session.analysisEnabled ? 1U : 0U) |
+                              (session.useNetwork ? 2U : 0U)));
+  out.u8(encodePlayer(session.engineSide));
+  out.u8(static_cast<uint8_t>(session.engineLevel));
+  return body;
+}
+
+auto joinRecord(int id, Player player, const TokenHash& hash)
+    -> std::string {
+  auto body = header(RecordType::Join, id);
+  binary::Writer out{ body };
+  out.u8(static_cast<uint8_t>(player));
+  out.bytes({ reinterpret_cast<const char*>(hash.data()), // NOLINT
+              hash.size() });
+  return body;
+}
+
+auto playerRecord(RecordType type, int id, Player player) -> std::string {
+  auto body = header(type, id);
+  binary::Writer{ body }.u8(static_cast<uint8_t>(player));
+  return body;
+}
+
+auto moveRecord(int id, uint64_t seq, const PersistedMove& move)
+    -> std::string {
+  auto body = header(RecordType::Move, id);
+  binary::Writer out{ body };
+  out.u32(static_cast<uint32_t>(seq));
+  out.u16(move.move.encode());
+  out.u64(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          move.ts.time_since_epoch())
+          .count()));
+  return body;
+}
+
+/// Renames and deletions are only durable once the directory is synced
+void syncDirectory(const std::filesystem::path& dir) {
+  const int fd{ ::open(dir.c_str(), O_RDONLY | O_DIRECTORY) }; // NOLINT
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+using Sessions = std::unordered_map<int, PersistedSession>;
+
+} // namespace
+
+SessionJournal::SessionJournal(Options options)
+    : options_{ std::move(options) } {
+  try {
+    std::filesystem::create_directories(options_.dir);
+    auto existing = journals(options_.dir);
+    journalNumber_ = existing.empty() ? 1 : existing.back().first + 1;
+  } catch (const std::filesystem::filesystem_error& e) {
+    throw JournalError(e.what());
+  }
+  open(journalNumber_);
+  writer_ = std::jthread([this] {
+    run();
+  });
+}
+
+SessionJournal::~SessionJournal() {
+  stop();
+}
+
+void SessionJournal::stop() {
+  {
+    std::scoped_lock lock{ mutex_ };
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+auto SessionJournal::journalPath(uint64_t number) const
+    -> std::filesystem::path {
+  return options_.dir / fmt::format("{}{}", s_JournalPrefix, number);
+}
+
+void SessionJournal::frame(std::string& out, const std::string& body) {
+  binary::Writer writer{ out };
+  writer.u16(static_cast<uint16_t>(body.size()));
+  writer.u32(checksum(body));
+  writer.bytes(body);
+}
+
+void SessionJournal::append(const std::string& body) {
+  std::scoped_lock lock{ mutex_ };
+  frame(pending_, body);
+}
+
+void SessionJournal::created(const PersistedSession& session) {
+  append(createRecord(session));
+}
+
+void SessionJournal::joined(int id, Player player,
+                            const TokenHash& hash) {
+  append(joinRecord(id, player, hash));
+}
+
+void SessionJournal::left(int id, Player player) {
+  append(playerRecord(RecordType::Leave, id, player));
+}
+
+void SessionJournal::moved(int id, uint64_t seq,
+                           const PersistedMove& move) {
+  append(moveRecord(id, seq, move));
+}
+
+void SessionJournal::resigned(int id, Player player) {
+  append(playerRecord(RecordType::Resign, id, player));
+}
+
+void SessionJournal::expired(int id) {
+  append(header(RecordType::Expire, id));
+}
+
+auto SessionJournal::rotate() -> uint64_t {
+  std::scoped_lock lock{ mutex_ };
+  // Records since the pending rotation already go to its new file
+  if (rotateTo_) {
+    return *rotateTo_;
+  }
+  sealed_.swap(pending_);
+  rotateTo_ = ++journalNumber_;
+  return *rotateTo_;
+}
+
+void SessionJournal::encode(std::string& out,
+                            const PersistedSession& session) {
+  // The same records a journal holds, so replay has a single path
+  frame(out, createRecord(session));
+  for (size_t p = 0; p < session.tokens.size(); p++) {
+    if (const auto& hash = session.tokens[p]) {
+      frame(out, joinRecord(session.id, static_cast<Player>(p), *hash));
+    }
+  }
+  for (size_t i = 0; i < session.moves.size(); i++) {
+    frame(out, moveRecord(session.id, i + 1, session.moves[i]));
+  }
+  if (session.resignedBy) {
+    frame(out, playerRecord(RecordType::Resign, session.id,
+                            *session.resignedBy));
+  }
+}
+
+void SessionJournal::writeSnapshot(std::string sessions,
+                                   uint64_t firstJournal) {
+  {
+    std::scoped_lock lock{ mutex_ };
+    snapshot_.emplace(std::move(sessions), firstJournal);
+  }
+  wake_.notify_one();
+}
+
+void SessionJournal::run() {
+  std::string writing;
+  std::unique_lock lock{ mutex_ };
+  while (true) {
+    wake_.wait_for(lock, options_.flushInterval, [&] {
+      return stopping_ || snapshot_.has_value();
+    });
+    // Swapping keeps both buffers' capacity
+    writing.clear();
+    writing.swap(pending_);
+    auto sealed   = std::exchange(sealed_, {});
+    auto rotateTo = std::exchange(rotateTo_, std::nullopt);
+    auto snapshot = std::exchange(snapshot_, std::nullopt);
+    bool stopping = stopping_;
+    lock.unlock();
+
+    if (rotateTo) {
+      write(sealed);
+      try {
+        open(*rotateTo);
+      } catch (const JournalError& e) {
+        // Like a failed write, journaling goes on in the old file
+        LOG_ERROR << e.what();
+      }
+    }
+    write(writing);
+    if (snapshot && snapshot->second > fdNumber_) {
+      // It would delete the file records still go to
+      LOG_ERROR << "Skipping snapshot, journal " << snapshot->second
+                << " was never opened";
+    } else if (snapshot) {
+      saveSnapshot(snapshot->first, snapshot->second);
+    }
+    if (stopping) {
+      ::close(fd_);
+      fd_ = -1;
+      return;
+    }
+    lock.lock();
+  }
+}
+
+void SessionJournal::open(uint64_t number) {
+  auto path = journalPath(number);
+  const int fd{ ::open(path.c_str(), // NOLINT
+                       O_WRONLY | O_CREAT | O_APPEND, 0644) };
+  if (fd < 0) {
+    throw JournalError(fmt::format("Could not open {}: {}", path.string(),
+                                   std::strerror(errno)));
+  }
+  // The old file stays in use if the new one cannot be opened
+  if (fd_ >= 0) {
+    ::fdatasync(fd_);
+    ::close(fd_);
+  }
+  fd_       = fd;
+  fdNumber_ = number;
+  std::string magic;
+  binary::Writer{ magic }.u32(s_JournalMagic);
+  write(magic);
+  syncDirectory(options_.dir);
+}
+
+void SessionJournal::write(const std::string& data) {
+  std::string_view rest{ data };
+  while (!rest.empty()) {
+    auto written = ::write(fd_, rest.data(), rest.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR << "Session journal write failed: "
+                << std::strerror(errno);
+      return;
+    }
+    rest.remove_prefix(static_cast<size_t>(written));
+  }
+  if (!data.empty()) {
+    ::fdatasync(fd_);
+  }
+}
+
+void SessionJournal::saveSnapshot(const std::string& sessions,
+                                  uint64_t firstJournal) {
+  auto path    = options_.dir / s_SnapshotName;
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+  const int fd{ ::open(tmpPath.c_str(), // NOLINT
+                       O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+  if (fd < 0) {
+    LOG_ERROR << "Could not write " << tmpPath.string() << ": "
+              << std::strerror(errno);
+    return;
+  }
+  std::string data;
+  data.reserve(sessions.size() + 12);
+  binary::Writer out{ data };
+  out.u32(s_SnapshotMagic);
+  out.u64(firstJournal);
+  out.bytes(sessions);
+
+  std::string_view rest{ data };
+  bool ok{ true };
+  while (ok && !rest.empty()) {
+    auto written = ::write(fd, rest.data(), rest.size());
+    if (written < 0 && errno != EINTR) {
+      ok = false;
+    } else if (written > 0) {
+      rest.remove_prefix(static_cast<size_t>(written));
+    }
+  }
+  ok = ok && ::fdatasync(fd) == 0;
+  ::close(fd);
+  if (!ok) {
+    LOG_ERROR << "Could not write " << tmpPath.string() << ": "
+              << std::strerror(errno);
+    return;
+  }
+
+  // Write aside and rename, a crash never leaves a torn snapshot
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    LOG_ERROR << "Could not replace " << path.string() << ": "
+              << ec.message();
+    return;
+  }
+  syncDirectory(options_.dir);
+  for (const auto& [number, journal] : journals(options_.dir)) {
+    if (number < firstJournal) {
+      std::filesystem::remove(journal, ec);
+    }
+  }
+}
+
+namespace {
+
+void apply(std::string_view body, Sessions& sessions) {
+  binary::Reader in{ body };
+  auto type = static_cast<RecordType>(in.u8());
+  auto id   = static_cast<int>(in.u32());
+  auto it   = sessions.find(id);
+
+  switch (type) {
+  case RecordType::Create: {
+    auto flags = in.u8();
+    PersistedSession session{ .id              = id,
+                              .analysisEnabled = (flags & 1U) != 0,
+                              .useNetwork      = (flags & 2U) != 0 };
+    session.engineSide  = decodePlayer(in.u8());
+    session.engineLevel = std::max<size_t>(in.u8(), 1);
+    // Already present when the snapshot captured it
+    sessions.try_emplace(id, std::move(session));
+    break;
+  }
+  case RecordType::Join: {
+    auto player = decodePlayer(in.u8());
+    auto bytes  = in.bytes(std::tuple_size_v<TokenHash>);
+    if (it != sessions.end() && player) {
+      auto& slot = it->second.tokens[static_cast<size_t>(*player)];
+      slot.emplace();
+      std::memcpy(slot->data(), bytes.data(), slot->size());
+    }
+    break;
+  }
+  case RecordType::Leave: {
+    auto player = decodePlayer(in.u8());
+    if (it != sessions.end() && player) {
+      it->second.tokens[static_cast<size_t>(*player)].reset();
+    }
+    break;
+  }
+  case RecordType::Move: {
+    auto seq  = in.u32();
+    auto move = binary::decodeMove(in.u16());
+    std::chrono::milliseconds ts{ in.u64() };
+    if (!move) {
+      throw binary::ProtocolError("Invalid move");
+    }
+    if (it == sessions.end()) {
+      break;
+    }
+    auto& moves = it->second.moves;
+    if (seq == moves.size() + 1) {
+      moves.push_back({ .move = *move,
+                        .ts   = std::chrono::system_clock::time_point{
+                            ts } });
+    } else if (seq > moves.size() + 1) {
+      LOG_WARN << "Missing moves before move " << seq << " of session "
+               << id;
+    }
+    break;
+  }
+  case RecordType::Resign: {
+    auto player = decodePlayer(in.u8());
+    if (it != sessions.end()) {
+      it->second.resignedBy = player;
+    }
+    break;
+  }
+  case RecordType::Expire:
+    if (it != sessions.end()) {
+      sessions.erase(it);
+    }
+    break;
+  default:
+    throw binary::ProtocolError("Unknown record");
+  }
+}
+
+/// Applies framed records until the data ends or a record is damaged
+void applyRecords(std::string_view data, Sessions& sessions,
+                  const std::filesystem::path& path) {
+  while (!data.empty()) {
+    binary::Reader in{ data };
+    try {
+      if (data.size() < s_FrameHeader) {
+        throw binary::ProtocolError("Torn record");
+      }
+      auto length = in.u16();
+      auto sum    = in.u32();
+      auto body   = in.bytes(length);
+      if (checksum(body) != sum) {
+        throw binary::ProtocolError("Checksum mismatch");
+      }
+      apply(body, sessions);
+      data.remove_prefix(s_FrameHeader + length);
+    } catch (const binary::ProtocolError& e) {
+      LOG_WARN << path.string() << ": " << e.what() << ", ignoring "
+               << data.size() << " bytes";
+      return;
+    }
+  }
+}
+
+/// The file's contents after its magic number, and the u64 that follows
+/// it for snapshots
+auto readFile(const MappedFile& file, uint32_t magic, bool snapshot)
+    -> std::optional<std::pair<std::string_view, uint64_t>> {
+  auto bytes = file.bytes();
+  std::string_view data{ reinterpret_cast<const char*>(bytes.data()),
+                         bytes.size() }; // NOLINT
+  binary::Reader in{ data };
+  try {
+    if (in.u32() != magic) {
+      return std::nullopt;
+    }
+    uint64_t firstJournal = snapshot ? in.u64() : 0;
+    data.remove_prefix(snapshot ? 12 : 4);
+    return std::make_pair(data, firstJournal);
+  } catch (const binary::ProtocolError&) {
+    return std::nullopt;
+  }
+}
+
+} // namespace
+
+auto SessionJournal::replay(const std::filesystem::path& dir)
+    -> std::vector<PersistedSession> {
+  Sessions sessions;
+  uint64_t firstJournal{ 0 };
+  try {
+    if (!std::filesystem::exists(dir)) {
+      return {};
+    }
+    auto snapshotPath = dir / s_SnapshotName;
+    if (std::filesystem::exists(snapshotPath)) {
+      MappedFile file{ snapshotPath };
+      auto contents = readFile(file, s_SnapshotMagic, true);
+      if (!contents) {
+        throw JournalError(fmt::format("Unsupported snapshot format: {}",
+                                       snapshotPath.string()));
+      }
+      firstJournal = contents->second;
+      applyRecords(contents->first, sessions, snapshotPath);
+    }
+
+    for (const auto& [number, path] : journals(dir)) {
+      if (number < firstJournal) {
+        continue;
+      }
+      MappedFile file{ path };
+      // Empty if the process died before writing the magic number
+      if (auto contents = readFile(file, s_JournalMagic, false)) {
+        applyRecords(contents->first, sessions, path);
+      }
+    }
+  } catch (const std::system_error& e) {
+    throw JournalError(e.what());
+  }
+
+  std::vector<PersistedSession> out;
+  out.reserve(sessions.size());
+  for (auto& [_, session] : sessions) {
+    out.push_back(std::move(session));
+  }
+  return out;
+}
+
+} // namespace kamisado
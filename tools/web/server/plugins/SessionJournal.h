@@ -0,0 +1,129 @@
+/**
+ *
+ *  SessionJournal.h
+ *
+ */
+
+#pragma once
+
+#include "kamisado/Move.hpp"
+#include "kamisado/Player.hpp"
+#include "sodium/crypto_generichash.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kamisado {
+
+using TokenHash = std::array<unsigned char, crypto_generichash_BYTES>;
+
+struct PersistedMove {
+  Move move;
+  std::chrono::system_clock::time_point ts;
+};
+
+/// Durable state of one session, captured for a snapshot or rebuilt by
+/// replay
+struct PersistedSession {
+  int id{ 0 };
+  bool analysisEnabled{ false };
+  bool useNetwork{ false };
+  std::optional<Player> engineSide{};
+  size_t engineLevel{ 1 };
+  /// Token hashes of the seated players, indexed by Player
+  std::array<std::optional<TokenHash>, 2> tokens{};
+  std::vector<PersistedMove> moves{};
+  std::optional<Player> resignedBy{};
+};
+
+struct JournalError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+/// Append-only log of session changes in numbered files journal.<n>,
+/// plus a snapshot of all live sessions that makes older files
+/// redundant. Records are buffered in memory and written and synced
+/// by a background thread every flush interval, so callers never wait
+/// for the disk and a crash loses at most one interval.
+///
+/// A snapshot is taken after rotate() and covers every journal before
+/// the one rotate() returned. Records in that journal may already be
+/// part of the snapshot, so replay applies them idempotently: moves
+/// carry their sequence number, everything else overwrites.
+class SessionJournal {
+public:
+  struct Options {
+    std::filesystem::path dir;
+    std::chrono::milliseconds flushInterval{ 100 };
+  };
+
+  /// Appends to a new journal after the newest one in dir. Throws
+  /// JournalError if the directory cannot be used
+  explicit SessionJournal(Options options);
+  ~SessionJournal();
+
+  SessionJournal(const SessionJournal&)                    = delete;
+  auto operator=(const SessionJournal&) -> SessionJournal& = delete;
+
+  void created(const PersistedSession& session);
+  void joined(int id, Player player, const TokenHash& hash);
+  void left(int id, Player player);
+  /// seq is the number of moves made including this one
+  void moved(int id, uint64_t seq, const PersistedMove& move);
+  void resigned(int id, Player player);
+  void expired(int id);
+
+  /// Starts a new journal file and returns its number
+  auto rotate() -> uint64_t;
+  /// Serialised form of one session for writeSnapshot()
+  static void encode(std::string& out, const PersistedSession& session);
+  /// Replaces the snapshot with sessions encoded after rotate()
+  /// returned firstJournal, then deletes the journals before it
+  void writeSnapshot(std::string sessions, uint64_t firstJournal);
+  /// Flushes the remaining records and stops the writer
+  void stop();
+
+  /// Sessions left by the snapshot and journals in dir, in no
+  /// particular order. A torn or corrupt record ends its file
+  static auto replay(const std::filesystem::path& dir)
+      -> std::vector<PersistedSession>;
+
+private:
+  /// Frames a record as u16 length, u32 checksum and body
+  static void frame(std::string& out, const std::string& body);
+  void append(const std::string& body);
+  void run();
+  /// Switches to the given journal, the old one stays in use if this
+  /// throws JournalError
+  void open(uint64_t number);
+  void write(const std::string& data);
+  void saveSnapshot(const std::string& sessions, uint64_t firstJournal);
+  auto journalPath(uint64_t number) const -> std::filesystem::path;
+
+private:
+  Options options_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Records not yet handed to the writer
+  std::string pending_;
+  // Records for the previous file, if a rotation is pending
+  std::string sealed_;
+  std::optional<uint64_t> rotateTo_;
+  std::optional<std::pair<std::string, uint64_t>> snapshot_;
+  uint64_t journalNumber_{ 0 };
+  bool stopping_{ false };
+  // Owned by the writer thread
+  int fd_{ -1 };
+  uint64_t fdNumber_{ 0 };
+  std::jthread writer_;
+};
+
+} // namespace kamisado
@@ -7,60 +7,523 @@
 #include "SessionManagerPlugin.h"
 #include "kamisado/Player.hpp"
 #include "sodium/utils.h"
+#include "trantor/utils/Logger.h"
+#include "utils/BinaryProtocol.h"
 #include "utils/Json.h"
+#include "utils/Metrics.h"
 #include "utils/Utils.h"
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <cassert>
 #include <chrono>
+#include <drogon/HttpAppFramework.h>
 #include <json/value.h>
+#include <mutex>
 #include <random>
 #include <sodium.h>
+#include <thread>
+#include <utility>
 
 using namespace drogon;
 
 namespace kamisado {
 
-int SessionManagerPlugin::s_IDCounter = 0;
+namespace {
+
+auto hashToken(const Token& token) -> TokenHash {
+  TokenHash tokenHash{};
+  crypto_generichash(reinterpret_cast<unsigned char*>(tokenHash.data()),
+                     tokenHash.size(),
+                     reinterpret_cast<const unsigned char*>(token.data()),
+                     token.size(), nullptr, 0);
+  return tokenHash;
+}
 
-Session::Session(bool analysisEnabled)
-    : s_{ std::make_unique<GameService>() },
-      analysisEnabled_{ analysisEnabled },
+// Sessions run on their loop, so one warm buffer per loop thread serves
+// all outgoing JSON messages
+auto messageBuffer() -> std::string& {
+  thread_local std::string buffer;
+  return buffer;
+}
+
+} // namespace
+
+Session::Session(int id, trantor::EventLoop* loop, bool analysisEnabled,
+                 bool useNetwork, AnalysisPool* analysisPool,
+                 std::chrono::milliseconds analysisInterval,
+                 std::optional<EngineOpponent> engine,
+                 SessionJournal* journal)
+    : id_{ id },
+      loop_{ loop },
+      s_{ std::make_unique<GameService>() },
+      analysisEnabled_{ analysisEnabled && analysisPool != nullptr },
+      useNetwork_{ useNetwork },
+      analysisPool_{ analysisPool },
+      analysisInterval_{ analysisInterval },
+      engine_{ engine },
+      journal_{ journal },
       lastActive_{ std::chrono::system_clock::now() } {
+  metrics::add(metrics::Gauge::Sessions, 1);
 }
 
-SessionManagerPlugin::SessionManagerPlugin()
-    : rng_{ std::random_device{}() } {
-  sessionCleanerThread_ = std::jthread([this] {
-    sessionCleaner();
-  });
+Session::~Session() {
+  metrics::add(metrics::Gauge::Sessions, -1);
+  metrics::add(metrics::Gauge::Subscribers,
+               -static_cast<int64_t>(subscribers_.size()));
+  if (analysisEnabled_) {
+    analysisPool_->cancel(id_);
+  }
+  if (engine_) {
+    engine_->pool->cancel(id_);
+  }
 }
 
 void SessionManagerPlugin::initAndStart(const Json::Value& config) {
+  auto weights = config.get("nnue_weights", "").asString();
+  if (!weights.empty()) {
+    try {
+      network_ = nnue::Network::load(weights);
+      LOG_INFO << "Loaded NNUE weights from " << weights;
+    } catch (const nnue::NetworkLoadError& e) {
+      LOG_ERROR << e.what();
+    }
+  }
+
+  auto bookPath = config.get("opening_book", "").asString();
+  if (!bookPath.empty()) {
+    try {
+      book_ = OpeningBook::open(bookPath);
+      LOG_INFO << "Loaded opening book with " << book_->size()
+               << " positions from " << bookPath;
+    } catch (const BookError& e) {
+      LOG_ERROR << e.what();
+    }
+  }
+
+  AnalysisPool::Options poolOptions{ .network = network_, .book = book_ };
+  if (auto entries = config.get("analysis_cache_entries", 100'000)
+                         .asUInt64();
+      entries > 0) {
+    poolOptions.cache = std::make_shared<ResultCache>(entries);
+  }
+  if (auto threads = config.get("analysis_threads", 0).asUInt();
+      threads > 0) {
+    poolOptions.threads = threads;
+  }
+  poolOptions.sliceNodes =
+      config.get("analysis_slice_nodes", Json::UInt64{ 200'000 })
+          .asUInt64();
+  poolOptions.maxNodes =
+      config.get("analysis_max_nodes", Json::UInt64{ 200'000'000 })
+          .asUInt64();
+  poolOptions.tableBytes =
+      config.get("analysis_tt_mb", 256).asUInt64() << 20U;
+  if (auto rate = config.get("analysis_max_rate", 10).asDouble();
+      rate > 0) {
+    analysisInterval_ =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>{ 1.0 / rate });
+  }
+  LOG_INFO << "Starting " << poolOptions.threads << " analysis threads";
+  analysisPool_ = std::make_unique<AnalysisPool>(std::move(poolOptions));
+
+  EnginePool::Options engineOptions{ .network = network_, .book = book_ };
+  engineOptions.threads =
+      std::max(config.get("engine_threads", 1).asUInt(), 1U);
+  engineOptions.tableBytes = config.get("engine_tt_mb", 64).asUInt64()
+                             << 20U;
+  std::chrono::milliseconds moveTime{
+    config.get("engine_move_ms", 1000).asInt64()
+  };
+  const auto& levels = config["engine_levels"];
+  if (levels.isArray() && !levels.empty()) {
+    for (const auto& nodes : levels) {
+      engineLevels_.push_back({ .maxNodes = nodes.asUInt64(),
+                                .maxTime  = moveTime });
+    }
+  } else {
+    for (uint64_t nodes :
+         { 1'000, 5'000, 20'000, 100'000, 400'000, 1'500'000 }) {
+      engineLevels_.push_back(
+          { .maxNodes = nodes, .maxTime = moveTime });
+    }
+  }
+  EnginePool::Options reviewOptions{ .network = network_, .book = book_ };
+  reviewOptions.threads = config.get("review_threads", 0).asUInt();
+  if (reviewOptions.threads == 0) {
+    reviewOptions.threads =
+        std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  reviewOptions.tableBytes = engineOptions.tableBytes;
+  enginePool_ = std::make_unique<EnginePool>(std::move(engineOptions));
+  reviewPool_ = std::make_unique<EnginePool>(std::move(reviewOptions));
+  reviewNodes_ =
+      config.get("review_nodes", Json::UInt64{ 200'000 }).asUInt64();
+
+  auto threads = std::max<size_t>(app().getThreadNum(), 1);
+  auto perShard = (s_MaxSessions + threads - 1) / threads;
+  for (size_t i = 0; i < threads; i++) {
+    auto shard  = std::make_unique<Shard>();
+    shard->loop = app().getIOLoop(i);
+    shard->slots.resize(perShard);
+    shard->freeList.reserve(perShard);
+    for (auto local = perShard; local-- > 0;) {
+      shard->freeList.push_back(static_cast<uint32_t>(local));
+    }
+    shard->wheel.resize(s_WheelSize);
+    shard->expiryTimer =
+        shard->loop->runEvery(s_ExpiryTick, [this, raw = shard.get()] {
+          expireSessions(*raw);
+        });
+    shards_.push_back(std::move(shard));
+  }
+
+  auto persistenceDir = config.get("persistence_dir", "").asString();
+  if (persistenceDir.empty()) {
+    return;
+  }
+  std::vector<PersistedSession> sessions;
+  try {
+    sessions = SessionJournal::replay(persistenceDir);
+  } catch (const JournalError& e) {
+    // Journaling on would soon delete the files that failed to load
+    LOG_ERROR << "Session persistence disabled: " << e.what();
+    return;
+  }
+  try {
+    journal_ = std::make_unique<SessionJournal>(SessionJournal::Options{
+        .dir           = persistenceDir,
+        .flushInterval = std::chrono::milliseconds{
+            config.get("journal_flush_ms", 100).asInt64() } });
+  } catch (const JournalError& e) {
+    LOG_ERROR << "Session journal disabled: " << e.what();
+  }
+  restore(std::move(sessions));
+  if (journal_) {
+    snapshotInterval_ = std::chrono::seconds{
+      std::max<int64_t>(config.get("snapshot_interval_s", 300).asInt64(),
+                        1)
+    };
+    snapshotTimer_ = app().getLoop()->runEvery(snapshotInterval_, [this] {
+      snapshot();
+    });
+  }
 }
 
 void SessionManagerPlugin::shutdown() {
-  running_ = false;
+  // A snapshot must not rotate a journal that is being stopped
+  app().getLoop()->invalidateTimer(snapshotTimer_);
+  // Stopping must not expire, and so unjournal, the remaining sessions
+  for (const auto& shard : shards_) {
+    shard->loop->invalidateTimer(shard->expiryTimer);
+  }
+  if (analysisPool_) {
+    analysisPool_->stop();
+  }
+  if (enginePool_) {
+    enginePool_->stop();
+  }
+  if (reviewPool_) {
+    reviewPool_->stop();
+  }
+  if (journal_) {
+    journal_->stop();
+  }
+}
+
+void SessionManagerPlugin::restore(
+    std::vector<PersistedSession> sessions) {
+  if (sessions.empty()) {
+    return;
+  }
+  auto count = sessions.size();
+  std::vector<std::vector<PersistedSession>> byShard(shards_.size());
+  for (auto& persisted : sessions) {
+    auto index = indexOf(persisted.id);
+    // The slab is smaller if the server now runs more IO threads
+    if (persisted.id < 0 ||
+        index / shards_.size() >=
+            shards_[index % shards_.size()]->slots.size()) {
+      LOG_WARN << "Dropping persisted session " << persisted.id
+               << " that does not fit the slab";
+      count--;
+      continue;
+    }
+    byShard[index % shards_.size()].push_back(std::move(persisted));
+  }
+
+  std::vector<std::vector<SeatedToken>> seated(shards_.size());
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve(shards_.size());
+    for (size_t i = 0; i < shards_.size(); i++) {
+      workers.emplace_back(
+          [this, i, &seated, list = std::move(byShard[i])]() mutable {
+            seated[i] = restoreShard(*shards_[i], std::move(list));
+          });
+    }
+  }
+  // Token shards are other threads' session shards, so tokens are added
+  // once all workers are done, one shard lock at a time
+  for (const auto& tokens : seated) {
+    for (const auto& [hash, seat] : tokens) {
+      auto& shard = tokenShard(hash);
+      std::unique_lock lock{ shard.mutex };
+      shard.tokens.insert_or_assign(hash, seat);
+    }
+  }
+  LOG_INFO << "Restored " << count << " sessions";
+}
+
+auto SessionManagerPlugin::restoreShard(
+    Shard& shard, std::vector<PersistedSession> sessions)
+    -> std::vector<SeatedToken> {
+  std::vector<SeatedToken> seated;
+  std::unique_lock lock{ shard.mutex };
+  for (const auto& persisted : sessions) {
+    auto index = indexOf(persisted.id);
+    auto local = index / shards_.size();
+    auto& slot = shard.slots[local];
+    if (slot.live) {
+      continue;
+    }
+    SessionOptions options{
+      .analysisEnabled = persisted.analysisEnabled,
+      .useNetwork      = persisted.useNetwork,
+      .engineSide      = persisted.engineSide,
+      .engineLevel     = std::clamp<size_t>(persisted.engineLevel, 1,
+                                            engineLevels_.size()),
+    };
+    auto session = makeSession(persisted.id, shard, options);
+    session->restore(persisted);
+    slot.generation = static_cast<uint32_t>(persisted.id) >> s_IndexBits;
+    slot.live       = true;
+    slot.entry      = Entry{ .session = std::move(session),
+                             .slots   = persisted.tokens,
+                             .options = options };
+    scheduleExpiry(shard, static_cast<uint32_t>(local), s_SessionTimeout);
+
+    for (size_t p = 0; p < persisted.tokens.size(); p++) {
+      if (const auto& hash = persisted.tokens[p]) {
+        seated.emplace_back(
+            *hash, std::make_pair(persisted.id, static_cast<Player>(p)));
+      }
+    }
+  }
+
+  shard.freeList.clear();
+  for (auto local = shard.slots.size(); local-- > 0;) {
+    if (!shard.slots[local].live) {
+      shard.freeList.push_back(static_cast<uint32_t>(local));
+    }
+  }
+  return seated;
+}
+
+void SessionManagerPlugin::snapshot() {
+  if (snapshotRunning_.exchange(true)) {
+    return;
+  }
+  // Changes after the rotation land in firstJournal and are replayed
+  // over the snapshot, see SessionJournal
+  auto firstJournal = journal_->rotate();
+  struct Capture {
+    std::mutex mutex;
+    std::string sessions;
+    size_t remaining{ 0 };
+  };
+  auto capture       = std::make_shared<Capture>();
+  capture->remaining = shards_.size();
+  for (const auto& shard : shards_) {
+    // Sessions are read on their loop, which owns their state
+    shard->loop->queueInLoop([this, capture, firstJournal,
+                              raw = shard.get()] {
+      std::string sessions;
+      {
+        std::shared_lock lock{ raw->mutex };
+        for (const auto& slot : raw->slots) {
+          if (!slot.live) {
+            continue;
+          }
+          const auto& entry = slot.entry;
+          PersistedSession persisted{
+            .id              = entry.session->id(),
+            .analysisEnabled = entry.options.analysisEnabled,
+            .useNetwork      = entry.options.useNetwork,
+            .engineSide      = entry.options.engineSide,
+            .engineLevel     = entry.options.engineLevel,
+            .tokens          = entry.slots,
+          };
+          entry.session->persist(persisted);
+          SessionJournal::encode(sessions, persisted);
+        }
+      }
+      bool last{ false };
+      {
+        std::scoped_lock lock{ capture->mutex };
+        capture->sessions += sessions;
+        last = --capture->remaining == 0;
+      }
+      if (last) {
+        journal_->writeSnapshot(std::move(capture->sessions),
+                                firstJournal);
+        snapshotRunning_ = false;
+      }
+    });
+  }
+}
+
+auto SessionManagerPlugin::makeID(uint32_t index, uint32_t generation)
+    -> int {
+  return static_cast<int>((generation << s_IndexBits) | index);
+}
+
+auto SessionManagerPlugin::indexOf(int id) -> uint32_t {
+  return static_cast<uint32_t>(id) & ((1U << s_IndexBits) - 1);
+}
+
+auto SessionManagerPlugin::sessionShard(int id) -> Shard& {
+  return *shards_[indexOf(id) % shards_.size()];
+}
+
+auto SessionManagerPlugin::find(Shard& shard, int id) -> Entry* {
+  auto local = indexOf(id) / shards_.size();
+  if (id < 0 || local >= shard.slots.size()) {
+    return nullptr;
+  }
+  auto& slot = shard.slots[local];
+  if (!slot.live || makeID(indexOf(id), slot.generation) != id) {
+    return nullptr;
+  }
+  return &slot.entry;
+}
+
+auto SessionManagerPlugin::tokenShard(const TokenHash& hash) const
+    -> Shard& {
+  return *shards_[TokenHashHasher{}(hash) % shards_.size()];
 }
 
 auto SessionManagerPlugin::create(SessionOptions options) -> int {
-  auto id = s_IDCounter++;
-  s_IDCounter %= s_MaxSessions;
-  Session session{ options.analysisEnabled };
-  sessions_.erase(id);
-  auto [_, inserted] = sessions_.try_emplace(id, std::move(session));
-  assert(inserted && "Session already exists");
-  return id;
+  auto start = nextShard_++;
+  for (size_t i = 0; i < shards_.size(); i++) {
+    auto shardIndex = (start + i) % shards_.size();
+    auto& shard     = *shards_[shardIndex];
+    std::unique_lock lock{ shard.mutex };
+    if (shard.freeList.empty()) {
+      continue;
+    }
+    auto local = shard.freeList.back();
+    shard.freeList.pop_back();
+
+    auto& slot = shard.slots[local];
+    auto id    = makeID(
+        static_cast<uint32_t>((local * shards_.size()) + shardIndex),
+        slot.generation);
+    slot.live  = true;
+    slot.entry = Entry{ .session = makeSession(id, shard, options),
+                        .options = options };
+    scheduleExpiry(shard, local, s_SessionTimeout);
+    if (journal_) {
+      journal_->created({ .id              = id,
+                          .analysisEnabled = options.analysisEnabled,
+                          .useNetwork      = options.useNetwork,
+                          .engineSide      = options.engineSide,
+                          .engineLevel     = options.engineLevel });
+    }
+    return id;
+  }
+  throw SessionException("Too many sessions");
 }
 
-auto SessionManagerPlugin::get(int id) -> Session& {
-  if (!sessions_.contains(id)) {
+auto SessionManagerPlugin::makeSession(int id, const Shard& shard,
+                                       const SessionOptions& options)
+    -> SessionPtr {
+  std::optional<EngineOpponent> engine;
+  if (options.engineSide) {
+    engine = EngineOpponent{
+      .side   = *options.engineSide,
+      .limits = engineLevels_.at(options.engineLevel - 1),
+      .pool   = enginePool_.get(),
+    };
+  }
+  return std::make_shared<Session>(
+      id, shard.loop, options.analysisEnabled, options.useNetwork,
+      analysisPool_.get(), analysisInterval_, engine, journal_.get());
+}
+
+auto SessionManagerPlugin::engineLevels() const -> size_t {
+  return engineLevels_.size();
+}
+
+void SessionManagerPlugin::reviewGame(
+    const std::vector<GameState>& positions, bool useNetwork,
+    ReviewCallback done) {
+  struct Review {
+    std::mutex mutex;
+    std::vector<SearchEngine::Result> results;
+    size_t remaining{ 0 };
+    // Set once done was called, either way
+    bool answered{ false };
+    ReviewCallback done;
+  };
+  auto review = std::make_shared<Review>();
+  review->results.resize(positions.size());
+  review->done = std::move(done);
+
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < positions.size(); i++) {
+    if (!positions[i].terminalStatus().terminal) {
+      pending.push_back(i);
+    }
+  }
+  review->remaining = pending.size();
+  if (pending.empty()) {
+    review->done(std::move(review->results));
+    return;
+  }
+
+  // Positions of one game share most of their subtrees, the pool's
+  // table carries them over between workers
+  for (auto i : pending) {
+    reviewPool_->submit(
+        s_ReviewID, positions[i], useNetwork,
+        { .maxNodes = reviewNodes_ },
+        [review, i](const SearchEngine::Result& result) {
+          bool last{ false };
+          {
+            std::scoped_lock lock{ review->mutex };
+            review->results[i] = result;
+            last = --review->remaining == 0 && !review->answered;
+            review->answered = review->answered || last;
+          }
+          if (last) {
+            review->done(std::move(review->results));
+          }
+        },
+        [review] {
+          {
+            std::scoped_lock lock{ review->mutex };
+            if (std::exchange(review->answered, true)) {
+              return;
+            }
+          }
+          review->done(std::nullopt);
+        });
+  }
+}
+
+auto SessionManagerPlugin::get(int id) -> SessionPtr {
+  auto& shard = sessionShard(id);
+  std::shared_lock lock{ shard.mutex };
+  auto* entry = find(shard, id);
+  if (!entry) {
     throw SessionException("Session does not exist");
   }
-  return sessions_.at(id);
+  return entry->session;
 }
 
 auto SessionManagerPlugin::join(int id, Player player) -> Token {
-  auto& session = get(id);
   std::array<std::byte, s_TokenLength> tokenRawBuf{};
 
   randombytes_buf(tokenRawBuf.data(), tokenRawBuf.size());
@@ -76,89 +539,292 @@ auto SessionManagerPlugin::join(int id, Player player) -> Token {
       tokenRawBuf.size(), sodium_base64_VARIANT_URLSAFE_NO_PADDING);
   token.resize(tokenLenWithNull - 1);
 
-  TokenHash tokenHash{};
-  crypto_generichash(
-      reinterpret_cast<unsigned char*>(tokenHash.data()),
-      tokenHash.size(),
-      reinterpret_cast<unsigned char*>(token.data()), // NOLINT
-      token.size(), nullptr, 0);
+  auto tokenHash = hashToken(token);
+  auto& shard    = sessionShard(id);
+  {
+    std::unique_lock lock{ shard.mutex };
+    auto* entry = find(shard, id);
+    if (!entry) {
+      throw SessionException("Session does not exist");
+    }
+    auto& slot = entry->slots[static_cast<size_t>(player)];
+    if (slot || entry->session->engineSide() == player) {
+      throw SessionException("Side already taken");
+    }
+    slot = tokenHash;
+    if (journal_) {
+      journal_->joined(id, player, tokenHash);
+    }
+  }
+
+  // The token shard may be the session shard, so it is locked separately
+  auto& tokens = tokenShard(tokenHash);
+  bool inserted{ false };
+  {
+    std::unique_lock lock{ tokens.mutex };
+    inserted =
+        tokens.tokens.try_emplace(tokenHash, std::make_pair(id, player))
+            .second;
+  }
 
-  if (tokens_.contains(tokenHash)) {
+  // The session may have expired, or the player left, between the two
+  // locks. Their dropTokens() then ran before the insert, so the token
+  // is still seated only if the slot still holds it
+  bool seated{ false };
+  {
+    std::unique_lock lock{ shard.mutex };
+    auto* entry = find(shard, id);
+    if (entry) {
+      auto& slot = entry->slots[static_cast<size_t>(player)];
+      seated     = slot == tokenHash;
+      if (seated && !inserted) {
+        slot.reset();
+        if (journal_) {
+          journal_->left(id, player);
+        }
+      }
+    }
+  }
+  if (!inserted) {
     throw SessionException("Token already exists");
   }
-  tokens_[tokenHash] = std::make_pair(id, player);
+  if (!seated) {
+    std::unique_lock lock{ tokens.mutex };
+    tokens.tokens.erase(tokenHash);
+    throw SessionException("Session does not exist");
+  }
 
   return token;
 }
 
 auto SessionManagerPlugin::auth(const Token& token) const
     -> std::optional<std::pair<int, Player>> {
-  TokenHash tokenHash{};
-  crypto_generichash(reinterpret_cast<unsigned char*>(tokenHash.data()),
-                     tokenHash.size(),
-                     reinterpret_cast<const unsigned char*>(token.data()),
-                     token.size(), nullptr, 0);
-
-  if (!tokens_.contains(tokenHash)) {
+  auto tokenHash = hashToken(token);
+  auto& shard    = tokenShard(tokenHash);
+  std::shared_lock lock{ shard.mutex };
+  auto it = shard.tokens.find(tokenHash);
+  if (it == shard.tokens.end()) {
     return std::nullopt;
   }
 
-  return tokens_.at(tokenHash);
+  return it->second;
+}
+void Session::post(std::function<void(Session&)> fn) {
+  loop_->runInLoop([self = shared_from_this(), fn = std::move(fn)] {
+    fn(*self);
+  });
 }
-void Session::subscribe(const drogon::WebSocketConnectionPtr& ws) {
-  subscribers_.insert(ws);
 
-  if (subscribers_.size() >= 2) {
+void Session::subscribe(const drogon::WebSocketConnectionPtr& ws,
+                        Protocol protocol) {
+  if (subscribers_.emplace(ws, protocol).second) {
+    metrics::add(metrics::Gauge::Subscribers, 1);
+  }
+  sendState(ws, protocol);
+  if (analysisEnabled_) {
+    analysisPool_->setWatched(id_, true);
+  }
+
+  if (subscribers_.size() >= (engine_ ? 1U : 2U)) {
     startGame();
   }
 }
+void Session::sendState(const drogon::WebSocketConnectionPtr& ws,
+                        Protocol protocol) const {
+  if (protocol == Protocol::Binary) {
+    ws->send(stateFrame(), drogon::WebSocketMessageType::Binary);
+    return;
+  }
+  JsonWriter out{ messageBuffer() };
+  out.beginObject();
+  out.key("type").string("state");
+  out.key("payload").raw(stateBody());
+  out.endObject();
+  ws->send(out.str().data(), out.str().size());
+}
+
 void Session::unsubscribe(const drogon::WebSocketConnectionPtr& ws) {
-  subscribers_.erase(ws);
+  if (subscribers_.erase(ws) > 0) {
+    metrics::add(metrics::Gauge::Subscribers, -1);
+  }
+  if (analysisEnabled_ && subscribers_.empty()) {
+    analysisPool_->setWatched(id_, false);
+  }
 }
 
 namespace {
 
-auto toJson(const MoveEntry& entry) -> Json::Value {
-  Json::Value out = toJson(entry.move);
-  out["side"]     = toJson(entry.player);
-  out["notation"] =
-      fmt::format("{}-{}", out["from"].asString(), out["to"].asString());
-  out["ts"] = std::chrono::duration_cast<std::chrono::milliseconds>(
-                  entry.ts.time_since_epoch())
-                  .count();
-  return out;
+void write(JsonWriter& out, const MoveEntry& entry) {
+  auto from = squareName(entry.move.from);
+  auto to   = squareName(entry.move.to);
+  std::array<char, 5> notation{ from[0], from[1], '-', to[0], to[1] };
+  out.beginObject();
+  out.key("from").string(from);
+  out.key("to").string(to);
+  out.key("side").string(playerName(entry.player));
+  out.key("notation").string({ notation.data(), notation.size() });
+  out.key("ts").number(
+      static_cast<int64_t>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              entry.ts.time_since_epoch())
+              .count()));
+  out.endObject();
 }
 
 } // namespace
 
-auto Session::stateJson() const -> Json::Value {
-  Json::Value state;
-  state["turnSide"] = toJson(s_->playerToMove());
+void Session::writeLegalMoves(JsonWriter& out) const {
+  const auto& moves = s_->availableMoves();
+  // Destinations grouped by origin square, in first-seen order
+  std::bitset<config::BoardSize * config::BoardSize> seen;
+  out.beginObject();
+  for (size_t i = 0; i < moves.size(); i++) {
+    auto from = moves[i].from;
+    auto square = (from.row * config::BoardSize) + from.col;
+    if (seen.test(square)) {
+      continue;
+    }
+    seen.set(square);
+    out.key(squareName(from));
+    out.beginArray();
+    for (size_t j = i; j < moves.size(); j++) {
+      if (moves[j].from == from) {
+        write(out, moves[j].to);
+      }
+    }
+    out.endArray();
+  }
+  out.endObject();
+}
+
+void Session::writeState(JsonWriter& out) const {
+  out.beginObject();
+  out.key("seq").number(seq_);
+  out.key("turnSide").string(playerName(s_->playerToMove()));
   if (s_->lastMove().has_value()) {
-    state["lastMove"] = toJson(*s_->lastMove());
+    out.key("lastMove");
+    write(out, *s_->lastMove());
   }
-  state["moves"] = Json::Value(Json::arrayValue);
+  out.key("moves").beginArray();
   for (const auto& moveEntry : moves_) {
-    state["moves"].append(toJson(moveEntry));
+    write(out, moveEntry);
+  }
+  out.endArray();
+  out.key("legalMovesMap");
+  writeLegalMoves(out);
+  out.key("terminal");
+  write(out, outcome());
+  out.key("board");
+  write(out, s_->board());
+  out.endObject();
+}
+
+auto Session::stateBody() const -> const std::string& {
+  if (stateBody_.empty()) {
+    metrics::Timer timer{ metrics::Histogram::StateSerialize };
+    JsonWriter out{ stateBody_ };
+    writeState(out);
+  }
+  return stateBody_;
+}
+
+auto Session::stateETag() const -> const std::string& {
+  if (stateETag_.empty()) {
+    stateETag_ = fmt::format("\"{:016x}-{}{}\"", s_->state().hash(),
+                             moves_.size(), resignedBy_ ? "r" : "");
+  }
+  return stateETag_;
+}
+
+void Session::writeDelta(JsonWriter& out, const MoveEntry& entry,
+                         std::optional<Tower> tower) const {
+  out.beginObject();
+  out.key("seq").number(seq_);
+  out.key("move");
+  write(out, entry);
+  out.key("pass").boolean(entry.move.isPass);
+  if (tower) {
+    out.key("tower");
+    write(out, *tower);
+  }
+  out.key("forcedColor");
+  if (auto forced = s_->state().forcedColor()) {
+    write(out, *forced);
+  } else {
+    out.null();
   }
-  state["legalMovesMap"] = Json::Value(Json::objectValue);
-  auto& mm               = state["legalMovesMap"];
+  out.key("turnSide").string(playerName(s_->playerToMove()));
+  out.key("legalMovesMap");
+  writeLegalMoves(out);
+  out.key("terminal");
+  write(out, outcome());
+  out.endObject();
+}
+
+auto Session::stateFrame() const -> std::string {
+  std::string frame;
+  binary::Writer out{ frame };
+  out.u8(static_cast<uint8_t>(binary::FrameType::State));
+  out.u32(static_cast<uint32_t>(seq_));
+  out.u8(static_cast<uint8_t>(s_->playerToMove()));
+  out.u8(binary::encodeOutcome(outcome()));
+  out.u8(binary::encodeColor(s_->state().forcedColor()));
+  auto cells = binary::encodeBoard(s_->board());
+  out.bytes({ reinterpret_cast<const char*>(cells.data()), // NOLINT
+              cells.size() });
+  out.u8(static_cast<uint8_t>(s_->availableMoves().size()));
   for (const auto& move : s_->availableMoves()) {
-    auto from = coordToFileRank(move.from);
-    if (!mm.isMember(from)) {
-      mm[from] = Json::Value(Json::arrayValue);
-    }
-    mm[from].append(toJson(move.to));
+    out.u16(move.encode());
+  }
+  out.u16(static_cast<uint16_t>(moves_.size()));
+  for (const auto& entry : moves_) {
+    out.u16(entry.move.encode());
+  }
+  return frame;
+}
+
+auto Session::deltaFrame(const MoveEntry& entry,
+                         std::optional<Tower> tower) const
+    -> std::string {
+  std::string frame;
+  binary::Writer out{ frame };
+  out.u8(static_cast<uint8_t>(binary::FrameType::Delta));
+  out.u32(static_cast<uint32_t>(seq_));
+  out.u16(entry.move.encode());
+  out.u8(binary::encodeCell(s_->board().coloring().at(entry.move.to),
+                            tower));
+  out.u8(static_cast<uint8_t>(s_->playerToMove()));
+  out.u8(binary::encodeOutcome(outcome()));
+  out.u8(binary::encodeColor(s_->state().forcedColor()));
+  out.u8(static_cast<uint8_t>(s_->availableMoves().size()));
+  for (const auto& move : s_->availableMoves()) {
+    out.u16(move.encode());
   }
-  auto terminalStatus = s_->state().terminalStatus();
-  state["terminal"]   = toJson(terminalStatus);
-  state["board"]      = toJson(s_->board());
-  return state;
+  return frame;
 }
 
-void Session::pushMessage(const Json::Value& message) {
-  for (const auto& ws : subscribers_) {
-    ws->sendJson(message);
+void Session::pushMessage(const std::function<void(JsonWriter&)>& json,
+                          const std::function<std::string()>& binary) {
+  metrics::Timer timer{ metrics::Histogram::FanOut };
+  // Encoded once for all viewers, each send only frames the bytes
+  std::optional<JsonWriter> text;
+  std::optional<std::string> frame;
+  for (const auto& [ws, protocol] : subscribers_) {
+    // Closing sockets are unsubscribed by their loop callback shortly
+    if (!ws->connected()) {
+      continue;
+    }
+    if (protocol == Protocol::Binary) {
+      if (!frame) {
+        frame = binary();
+      }
+      ws->send(*frame, drogon::WebSocketMessageType::Binary);
+    } else {
+      if (!text) {
+        json(text.emplace(messageBuffer()));
+      }
+      ws->send(text->str().data(), text->str().size());
+    }
   }
 }
 
@@ -170,7 +836,17 @@ auto Session::game() const -> const GameService& {
   return *s_;
 }
 
+auto Session::outcome() const -> Outcome {
+  if (resignedBy_) {
+    return { .terminal = true, .winner = opposite(*resignedBy_) };
+  }
+  return s_->state().terminalStatus();
+}
+
 void Session::makeMove(Move move) {
+  if (resignedBy_) {
+    throw SessionException("Game is over");
+  }
   const Board& board = s_->board();
   if (!board.inBounds(move.from) || !board.inBounds(move.to)) {
     throw SessionException("Move out of bounds");
@@ -181,12 +857,26 @@ void Session::makeMove(Move move) {
     throw SessionException("Illegal move");
   }
 
+  auto tower = move.isPass ? std::nullopt : board.towerAt(move.from);
   s_->makeMove(move);
-  moves_.emplace_back(move, playerToMove());
-  Json::Value msg;
-  msg["type"]    = "delta";
-  msg["payload"] = stateJson();
-  pushMessage(msg);
+  const auto& entry = moves_.emplace_back(move, playerToMove());
+  seq_++;
+  if (journal_) {
+    journal_->moved(id_, seq_, { .move = move, .ts = entry.ts });
+  }
+  stateBody_.clear();
+  stateETag_.clear();
+  pushMessage(
+      [&](JsonWriter& out) {
+        out.beginObject();
+        out.key("type").string("delta");
+        out.key("payload");
+        writeDelta(out, entry, tower);
+        out.endObject();
+      },
+      [&] {
+        return deltaFrame(entry, tower);
+      });
   lastActive_ = std::chrono::system_clock::now();
 
   if (s_->availableMoves().size() == 1 &&
@@ -195,92 +885,330 @@ void Session::makeMove(Move move) {
     return;
   }
 
-  if (analysisEnabled_ && !s_->state().terminalStatus().terminal) {
-    s_->startEngineSearch();
+  requestEngineMove();
+  if (analysisEnabled_) {
+    startAnalysis();
   }
 }
 
-void Session::startGame() {
-  Json::Value readyMessage;
-  readyMessage["type"] = "ready";
-  pushMessage(readyMessage);
+void Session::resign(Player player) {
+  if (outcome().terminal) {
+    throw SessionException("Game is over");
+  }
+  resignedBy_ = player;
+  lastActive_ = std::chrono::system_clock::now();
+  if (journal_) {
+    journal_->resigned(id_, player);
+  }
+  stateBody_.clear();
+  stateETag_.clear();
+  if (analysisEnabled_) {
+    analysisPool_->cancel(id_);
+    pendingAnalysis_.reset();
+  }
 
-  s_->setEngineCallback([this](const SearchEngine::Result& result) {
-    if (!result.bestMove.has_value()) {
-      return;
+  pushMessage(
+      [&](JsonWriter& out) {
+        out.beginObject();
+        out.key("type").string("terminal");
+        out.key("payload").beginObject();
+        out.key("status").string("win");
+        out.key("winner").string(playerName(opposite(player)));
+        out.key("reason").string("resign");
+        out.endObject();
+        out.endObject();
+      },
+      [&] {
+        std::string frame;
+        binary::Writer out{ frame };
+        out.u8(static_cast<uint8_t>(binary::FrameType::Terminal));
+        out.u8(binary::encodeOutcome(outcome()));
+        out.u8(static_cast<uint8_t>(player));
+        return frame;
+      });
+}
+
+void Session::restore(const PersistedSession& persisted) {
+  for (const auto& [move, ts] : persisted.moves) {
+    const auto& legalMoves = s_->availableMoves();
+    if (std::ranges::find(legalMoves, move) == legalMoves.end()) {
+      LOG_ERROR << fmt::format(
+          "Persisted session {} has an illegal move at {}, keeping {}",
+          id_, seq_ + 1, seq_);
+      break;
     }
+    s_->makeMove(move);
+    moves_.emplace_back(move, playerToMove(), ts);
+    seq_++;
+  }
+  resignedBy_ = persisted.resignedBy;
+}
 
-    Json::Value msg;
-    msg["type"]                = "analysis";
-    msg["payload"]             = Json::objectValue;
-    msg["payload"]["bestMove"] = toJson(*result.bestMove);
-    auto whiteScore =
-        result.score * (s_->playerToMove() == Player::White ? 1 : -1);
-    msg["payload"]["advantageWhite"] = Evaluator::normalize(whiteScore);
-    msg["payload"]["formattedScoreWhite"] =
-        Evaluator::formatScoreNorm(whiteScore);
-    msg["payload"]["formattedScoreBlack"] =
-        Evaluator::formatScoreNorm(-whiteScore);
-    pushMessage(msg);
-  });
+void Session::persist(PersistedSession& out) const {
+  out.moves.reserve(moves_.size());
+  for (const auto& entry : moves_) {
+    out.moves.push_back({ .move = entry.move, .ts = entry.ts });
+  }
+  out.resignedBy = resignedBy_;
+}
+
+void Session::startGame() {
+  pushMessage(
+      [](JsonWriter& out) {
+        out.beginObject().key("type").string("ready").endObject();
+      },
+      [] {
+        return std::string(1, static_cast<char>(binary::FrameType::Ready));
+      });
 
+  requestEngineMove();
   if (analysisEnabled_) {
-    s_->startEngineSearch();
+    startAnalysis();
+  }
+}
+
+void Session::requestEngineMove() {
+  if (!engine_ || outcome().terminal ||
+      playerToMove() != engine_->side || engineRequestSeq_ == seq_) {
+    return;
+  }
+  engineRequestSeq_ = seq_;
+  engine_->pool->submit(
+      id_, s_->state(), useNetwork_, engine_->limits,
+      [weak = weak_from_this(), loop = loop_,
+       seq = seq_](const SearchEngine::Result& r) {
+        loop->queueInLoop([weak, r, seq] {
+          if (auto session = weak.lock()) {
+            session->onEngineMove(r, seq);
+          }
+        });
+      });
+}
+
+void Session::onEngineMove(const SearchEngine::Result& result,
+                           uint64_t seq) {
+  if (seq != seq_ || !result.bestMove || outcome().terminal) {
+    return;
+  }
+  try {
+    makeMove(*result.bestMove);
+  } catch (const SessionException& e) {
+    LOG_ERROR << fmt::format("Engine move rejected in session {}: {}",
+                             id_, e.what());
   }
 }
 
+void Session::startAnalysis() {
+  if (outcome().terminal) {
+    analysisPool_->cancel(id_);
+    return;
+  }
+  // Results of the previous position are still pending or in flight
+  pendingAnalysis_.reset();
+  analysisPool_->submit(
+      id_, s_->state(), useNetwork_,
+      [weak = weak_from_this(), loop = loop_, side = s_->playerToMove(),
+       seq = seq_](const SearchEngine::Result& r, bool final) {
+        loop->queueInLoop([weak, r, side, seq, final] {
+          if (auto session = weak.lock()) {
+            session->onAnalysis(r, side, seq, final);
+          }
+        });
+      });
+  analysisPool_->setWatched(id_, !subscribers_.empty());
+}
+
+void Session::onAnalysis(const SearchEngine::Result& result,
+                         Player sideToMove, uint64_t seq, bool final) {
+  if (!result.bestMove.has_value() || seq != seq_ ||
+      outcome().terminal) {
+    return;
+  }
+  pendingAnalysis_ = PendingAnalysis{ .result     = result,
+                                      .sideToMove = sideToMove };
+
+  auto now = std::chrono::steady_clock::now();
+  auto due = lastAnalysisSent_ + analysisInterval_;
+  if (final || now >= due) {
+    flushAnalysis();
+    return;
+  }
+  // One timer per burst, it sends whatever is latest when it fires
+  if (!analysisFlushScheduled_) {
+    analysisFlushScheduled_ = true;
+    loop_->runAfter(due - now, [weak = weak_from_this()] {
+      if (auto session = weak.lock()) {
+        session->analysisFlushScheduled_ = false;
+        session->flushAnalysis();
+      }
+    });
+  }
+}
+
+void Session::flushAnalysis() {
+  if (!pendingAnalysis_) {
+    return;
+  }
+  auto [result, sideToMove] = *std::exchange(pendingAnalysis_, {});
+  lastAnalysisSent_         = std::chrono::steady_clock::now();
+
+  auto whiteScore = result.score * (sideToMove == Player::White ? 1 : -1);
+  pushMessage(
+      [&](JsonWriter& out) {
+        out.beginObject();
+        out.key("type").string("analysis");
+        out.key("payload").beginObject();
+        out.key("bestMove");
+        write(out, *result.bestMove);
+        out.key("advantageWhite")
+            .number(static_cast<double>(Evaluator::normalize(whiteScore)));
+        out.key("formattedScoreWhite")
+            .string(Evaluator::formatScoreNorm(whiteScore));
+        out.key("formattedScoreBlack")
+            .string(Evaluator::formatScoreNorm(-whiteScore));
+        out.endObject();
+        out.endObject();
+      },
+      [&] {
+        std::string frame;
+        binary::Writer out{ frame };
+        out.u8(static_cast<uint8_t>(binary::FrameType::Analysis));
+        out.u16(result.bestMove->encode());
+        out.i32(whiteScore);
+        return frame;
+      });
+}
+
 auto Session::analysisEnabled() const -> bool {
   return analysisEnabled_;
 }
 
+auto Session::useNetwork() const -> bool {
+  return useNetwork_;
+}
+
+auto Session::moves() const -> const std::list<MoveEntry>& {
+  return moves_;
+}
+
+auto Session::engineSide() const -> std::optional<Player> {
+  return engine_ ? std::optional{ engine_->side } : std::nullopt;
+}
+
+auto Session::id() const -> int {
+  return id_;
+}
+
+auto Session::loop() const -> trantor::EventLoop* {
+  return loop_;
+}
+
 auto SessionManagerPlugin::randomFreeSlot(int id) -> Player {
-  auto predicate = [id](const auto& kv) {
-    return kv.second.first == id;
-  };
+  Slots slots;
+  std::optional<Player> engineSide;
+  {
+    auto& shard = sessionShard(id);
+    std::shared_lock lock{ shard.mutex };
+    auto* entry = find(shard, id);
+    if (!entry) {
+      throw SessionException("Session does not exist");
+    }
+    slots      = entry->slots;
+    engineSide = entry->session->engineSide();
+  }
+  if (engineSide) {
+    // The human's side, taken or not, join() reports a conflict
+    return opposite(*engineSide);
+  }
 
-  if (std::ranges::count_if(tokens_, predicate) >= 2) {
+  auto white = slots[static_cast<size_t>(Player::White)].has_value();
+  auto black = slots[static_cast<size_t>(Player::Black)].has_value();
+  if (white && black) {
     throw SessionException("No free slots");
   }
 
-  auto it = std::ranges::find_if(tokens_, predicate);
-
-  if (it == tokens_.end()) {
-    return std::uniform_int_distribution<>{ 0, 1 }(rng_) ? Player::White
-                                                         : Player::Black;
+  if (!white && !black) {
+    thread_local std::mt19937 rng{ std::random_device{}() };
+    return std::uniform_int_distribution<>{ 0, 1 }(rng) ? Player::White
+                                                        : Player::Black;
   }
 
-  return opposite(it->second.second);
+  return white ? Player::Black : Player::White;
 }
 
 void SessionManagerPlugin::leave(int id, Player player) {
-  auto it = std::ranges::find_if(tokens_, [id, player](const auto& kv) {
-    return kv.second == std::make_pair(id, player);
-  });
-  if (it != tokens_.end()) {
-    tokens_.erase(it);
+  Slots slots;
+  {
+    auto& shard = sessionShard(id);
+    std::unique_lock lock{ shard.mutex };
+    auto* entry = find(shard, id);
+    if (!entry) {
+      return;
+    }
+    std::swap(slots[static_cast<size_t>(player)],
+              entry->slots[static_cast<size_t>(player)]);
+    if (journal_ && slots[static_cast<size_t>(player)]) {
+      journal_->left(id, player);
+    }
   }
+  dropTokens(slots);
 }
 
-void SessionManagerPlugin::sessionCleaner() {
-  while (running_) {
-    std::this_thread::sleep_for(std::chrono::seconds(60));
+void SessionManagerPlugin::dropTokens(const Slots& slots) {
+  for (const auto& hash : slots) {
+    if (!hash) {
+      continue;
+    }
+    auto& shard = tokenShard(*hash);
+    std::unique_lock lock{ shard.mutex };
+    shard.tokens.erase(*hash);
+  }
+}
 
-    auto now = std::chrono::system_clock::now();
-    for (auto it = sessions_.begin(); it != sessions_.end();) {
-      auto&& [id, session] = *it;
-      auto delta = std::chrono::duration_cast<std::chrono::minutes>(
-                       now - session.lastActive())
-                       .count();
-      if (delta > 30) {
-        it = sessions_.erase(it);
-        std::erase_if(tokens_, [id](const auto& kv) {
-          return kv.second.first == id;
-        });
-      } else {
-        it++;
+void SessionManagerPlugin::scheduleExpiry(
+    Shard& shard, uint32_t local,
+    std::chrono::system_clock::duration after) {
+  // Rounded up, so a session is never checked before its deadline
+  auto ticks = (after + s_ExpiryTick - std::chrono::nanoseconds{ 1 }) /
+               s_ExpiryTick;
+  auto ahead = static_cast<size_t>(std::clamp<int64_t>(
+      ticks, 1, static_cast<int64_t>(s_WheelSize) - 1));
+  shard.wheel[(shard.tick + ahead) % s_WheelSize].push_back(local);
+}
+
+void SessionManagerPlugin::expireSessions(Shard& shard) {
+  auto now = std::chrono::system_clock::now();
+  std::vector<Entry> expired;
+  {
+    std::unique_lock lock{ shard.mutex };
+    shard.tick = (shard.tick + 1) % s_WheelSize;
+    auto due   = std::exchange(shard.wheel[shard.tick], {});
+    for (auto local : due) {
+      auto& slot = shard.slots[local];
+      if (!slot.live) {
+        continue;
+      }
+      // Runs on the shard's loop, which owns lastActive
+      auto idle = now - slot.entry.session->lastActive();
+      if (idle <= s_SessionTimeout) {
+        scheduleExpiry(shard, local, s_SessionTimeout - idle);
+        continue;
       }
+      if (journal_) {
+        journal_->expired(slot.entry.session->id());
+      }
+      expired.push_back(std::exchange(slot.entry, {}));
+      slot.live = false;
+      slot.generation =
+          (slot.generation + 1) & ((1U << s_GenerationBits) - 1);
+      shard.freeList.push_back(local);
     }
   }
+
+  for (const auto& entry : expired) {
+    dropTokens(entry.slots);
+  }
+  // Sessions are destroyed here, outside the shard lock
 }
 
 } // namespace kamisado
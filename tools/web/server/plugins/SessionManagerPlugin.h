@@ -6,63 +6,164 @@
 
 #pragma once
 
+#include "AnalysisPool.h"
+#include "EnginePool.h"
+#include "SessionJournal.h"
 #include "drogon/WebSocketConnection.h"
 #include "kamisado/GameService.hpp"
 #include "kamisado/Move.hpp"
-#include "sodium/crypto_generichash.h"
+#include "kamisado/Nnue.hpp"
+#include "kamisado/OpeningBook.hpp"
+#include "trantor/net/EventLoop.h"
+#include "utils/JsonWriter.h"
+#include <atomic>
 #include <drogon/plugins/Plugin.h>
+#include <functional>
 #include <list>
 #include <memory>
-#include <random>
+#include <shared_mutex>
 #include <stdexcept>
 
 namespace kamisado {
 
-using Token     = std::string;
-using TokenHash = std::array<unsigned char, crypto_generichash_BYTES>;
+using Token = std::string;
 
 struct MoveEntry {
-  MoveEntry(Move move, Player player)
+  MoveEntry(Move move, Player player,
+            std::chrono::system_clock::time_point ts =
+                std::chrono::system_clock::now())
       : move{ move },
-        player{ player } {
-    ts = std::chrono::system_clock::now();
-  }
+        player{ player },
+        ts{ ts } {}
 
   Move move;
   Player player;
   std::chrono::system_clock::time_point ts;
 };
 
-class Session {
+/// Wire format of a websocket subscriber, see utils/BinaryProtocol.h
+enum class Protocol : uint8_t {
+  Json,
+  Binary
+};
+
+/// Side played by the server and the search budget of its level
+struct EngineOpponent {
+  Player side;
+  SearchEngine::Limits limits;
+  EnginePool* pool{ nullptr };
+};
+
+/// Game state of one session. Apart from the immutable options it is
+/// only touched on its owning event loop, see post()
+class Session : public std::enable_shared_from_this<Session> {
 public:
-  explicit Session(bool analysisEnabled);
+  Session(int id, trantor::EventLoop* loop, bool analysisEnabled,
+          bool useNetwork, AnalysisPool* analysisPool,
+          std::chrono::milliseconds analysisInterval,
+          std::optional<EngineOpponent> engine, SessionJournal* journal);
+  ~Session();
+
+  Session(const Session&)                    = delete;
+  auto operator=(const Session&) -> Session& = delete;
 
+  auto id() const -> int;
   auto game() const -> const GameService&;
   auto analysisEnabled() const -> bool;
-  [[nodiscard]] auto stateJson() const -> Json::Value;
+  auto useNetwork() const -> bool;
+  auto engineSide() const -> std::optional<Player>;
+  auto moves() const -> const std::list<MoveEntry>&;
+  auto loop() const -> trantor::EventLoop*;
+  /// Full snapshot, sent on (re)connect
+  void writeState(JsonWriter& out) const;
+  /// Serialised writeState(), cached until the state changes
+  auto stateBody() const -> const std::string&;
+  /// Changes whenever stateBody() does
+  auto stateETag() const -> const std::string&;
   auto playerToMove() const -> Player;
+  /// Accounts for resignation, unlike the game state
+  auto outcome() const -> Outcome;
   auto lastActive() const {
     return lastActive_;
   }
 
-  void subscribe(const drogon::WebSocketConnectionPtr& ws);
+  /// Runs fn on the owning event loop, inline if already there
+  void post(std::function<void(Session&)> fn);
+  void subscribe(const drogon::WebSocketConnectionPtr& ws,
+                 Protocol protocol);
   void unsubscribe(const drogon::WebSocketConnectionPtr& ws);
+  /// Sends the snapshot to one subscriber only
+  void sendState(const drogon::WebSocketConnectionPtr& ws,
+                 Protocol protocol) const;
   void makeMove(Move move);
+  void resign(Player player);
+  /// Replays persisted moves without broadcasting or journaling them,
+  /// before the session is shared
+  void restore(const PersistedSession& persisted);
+  /// Adds the moves and resignation to a snapshot of the session
+  void persist(PersistedSession& out) const;
 
 private:
-  void pushMessage(const Json::Value& message);
+  /// Incremental update for the move just made
+  void writeDelta(JsonWriter& out, const MoveEntry& entry,
+                  std::optional<Tower> tower) const;
+  void writeLegalMoves(JsonWriter& out) const;
+  [[nodiscard]] auto stateFrame() const -> std::string;
+  [[nodiscard]] auto deltaFrame(const MoveEntry& entry,
+                                std::optional<Tower> tower) const
+      -> std::string;
+  /// Builds each encoding at most once, and only if a subscriber uses it
+  void pushMessage(const std::function<void(JsonWriter&)>& json,
+                   const std::function<std::string()>& binary);
   void startGame();
+  void startAnalysis();
+  /// Keeps only the latest result and sends at most one per
+  /// analysisInterval_, the final one immediately
+  void onAnalysis(const SearchEngine::Result& result, Player sideToMove,
+                  uint64_t seq, bool final);
+  void flushAnalysis();
+  /// Asks the pool for a move if the engine is to play
+  void requestEngineMove();
+  void onEngineMove(const SearchEngine::Result& result, uint64_t seq);
 
 private:
+  int id_;
+  trantor::EventLoop* loop_;
   std::unique_ptr<GameService> s_;
   bool analysisEnabled_{ false };
+  bool useNetwork_{ false };
+  AnalysisPool* analysisPool_{ nullptr };
+  std::chrono::milliseconds analysisInterval_;
+  struct PendingAnalysis {
+    SearchEngine::Result result;
+    Player sideToMove;
+  };
+  std::optional<PendingAnalysis> pendingAnalysis_;
+  std::chrono::steady_clock::time_point lastAnalysisSent_;
+  bool analysisFlushScheduled_{ false };
   std::list<MoveEntry> moves_;
-  std::unordered_set<drogon::WebSocketConnectionPtr> subscribers_;
+  std::optional<Player> resignedBy_;
+  std::optional<EngineOpponent> engine_;
+  SessionJournal* journal_{ nullptr };
+  // Position, by seq, the engine was last asked to move in
+  std::optional<uint64_t> engineRequestSeq_;
+  mutable std::string stateBody_;
+  mutable std::string stateETag_;
+  // Number of moves made, lets clients detect missed deltas
+  uint64_t seq_{ 0 };
+  std::unordered_map<drogon::WebSocketConnectionPtr, Protocol>
+      subscribers_;
   std::chrono::system_clock::time_point lastActive_;
 };
 
+using SessionPtr = std::shared_ptr<Session>;
+
 struct SessionOptions {
   bool analysisEnabled{ false };
+  bool useNetwork{ false };
+  /// The server plays this side at engineLevel, 1 being the weakest
+  std::optional<Player> engineSide;
+  size_t engineLevel{ 1 };
 };
 
 struct SessionException : std::runtime_error {
@@ -71,27 +172,30 @@ struct SessionException : std::runtime_error {
 
 class SessionManagerPlugin : public drogon::Plugin<SessionManagerPlugin> {
 public:
-  SessionManagerPlugin();
   void initAndStart(const Json::Value& config) override;
 
   void shutdown() override;
 
   [[nodiscard]] auto create(SessionOptions options) -> int;
-  auto get(int id) -> Session&;
+  auto engineLevels() const -> size_t;
+
+  /// One result per position, or nullopt if the server stopped first
+  using ReviewCallback = std::function<void(
+      std::optional<std::vector<SearchEngine::Result>>)>;
+  /// Searches every non-terminal position with the review budget on the
+  /// review pool, in parallel. done receives one result per position,
+  /// empty for terminal ones, on a worker thread
+  void reviewGame(const std::vector<GameState>& positions,
+                  bool useNetwork, ReviewCallback done);
+  auto get(int id) -> SessionPtr;
 
   [[nodiscard]] auto auth(const Token& token) const
       -> std::optional<std::pair<int, Player>>;
   [[nodiscard]] auto join(int id, Player player) -> Token;
   void leave(int id, Player player);
   auto randomFreeSlot(int id) -> Player;
-private:
-  void sessionCleaner();
 
 private:
-  constexpr static int s_MaxSessions    = 10'000;
-  static constexpr size_t s_TokenLength = 32;
-  static int s_IDCounter;
-
   struct TokenHashHasher {
     auto operator()(const TokenHash& h) const -> std::size_t {
       std::string_view hStr{ reinterpret_cast<const char*>(h.data()),
@@ -100,11 +204,101 @@ private:
     }
   };
 
-  std::mt19937 rng_;
-  std::unordered_map<int, Session> sessions_;
-  std::unordered_map<TokenHash, std::pair<int, Player>, TokenHashHasher>
-      tokens_;
-  std::jthread sessionCleanerThread_;
-  bool running_{ true };
+  /// Token hashes of the players seated in a session, indexed by Player
+  using Slots = std::array<std::optional<TokenHash>, 2>;
+
+  struct Entry {
+    SessionPtr session;
+    Slots slots{};
+    SessionOptions options{};
+  };
+
+  struct SlabSlot {
+    uint32_t generation{ 0 };
+    bool live{ false };
+    Entry entry;
+  };
+
+  /// Session IDs are (generation << s_IndexBits) | index, the index
+  /// selects a slab slot and slot index % shards its shard, one per IO
+  /// loop. Freed slots bump their generation, so stale IDs miss.
+  /// Tokens are spread by their hash
+  struct Shard {
+    trantor::EventLoop* loop{ nullptr };
+    mutable std::shared_mutex mutex;
+    // Indexed by slot index / shards
+    std::vector<SlabSlot> slots;
+    std::vector<uint32_t> freeList;
+    std::unordered_map<TokenHash, std::pair<int, Player>, TokenHashHasher>
+        tokens;
+    // Slot indices by the expiry tick they are next checked at, see
+    // expireSessions(). Every live slot is in exactly one bucket
+    std::vector<std::vector<uint32_t>> wheel;
+    size_t tick{ 0 };
+    trantor::TimerId expiryTimer{ trantor::InvalidTimerId };
+  };
+
+  static auto makeID(uint32_t index, uint32_t generation) -> int;
+  static auto indexOf(int id) -> uint32_t;
+  auto sessionShard(int id) -> Shard&;
+  /// Caller holds the shard lock
+  auto find(Shard& shard, int id) -> Entry*;
+  auto tokenShard(const TokenHash& hash) const -> Shard&;
+  /// Checks the sessions due this tick, expiring the idle ones and
+  /// moving the others to the tick their timeout ends at. Activity does
+  /// not touch the wheel, so the work is proportional to the sessions
+  /// due, not to all sessions
+  void expireSessions(Shard& shard);
+  /// Caller holds the shard lock
+  static void scheduleExpiry(Shard& shard, uint32_t local,
+                             std::chrono::system_clock::duration after);
+  void dropTokens(const Slots& slots);
+  auto makeSession(int id, const Shard& shard,
+                   const SessionOptions& options) -> SessionPtr;
+  using SeatedToken = std::pair<TokenHash, std::pair<int, Player>>;
+  /// Installs replayed sessions under their old IDs, one thread per
+  /// shard
+  void restore(std::vector<PersistedSession> sessions);
+  /// Holds only the shard's own lock, returns the tokens to add
+  auto restoreShard(Shard& shard, std::vector<PersistedSession> sessions)
+      -> std::vector<SeatedToken>;
+  /// Rotates the journal and captures every shard on its loop
+  void snapshot();
+
+private:
+  constexpr static int s_MaxSessions       = 10'000;
+  static constexpr unsigned s_IndexBits    = 14;
+  static constexpr unsigned s_GenerationBits = 31 - s_IndexBits;
+  static_assert(s_MaxSessions < (1 << s_IndexBits));
+  static constexpr size_t s_TokenLength = 32;
+  static constexpr std::chrono::minutes s_SessionTimeout{ 30 };
+  static constexpr std::chrono::seconds s_ExpiryTick{ 10 };
+  // Deadlines are at most one timeout ahead, so one wheel level covers
+  // them
+  static constexpr size_t s_WheelSize =
+      (s_SessionTimeout / s_ExpiryTick) + 1;
+
+  std::shared_ptr<const nnue::Network> network_;
+  std::shared_ptr<const OpeningBook> book_;
+  // Sessions cancel their jobs on destruction, so the pool outlives them
+  std::unique_ptr<AnalysisPool> analysisPool_;
+  std::chrono::milliseconds analysisInterval_{ 100 };
+  std::unique_ptr<EnginePool> enginePool_;
+  // Search budget by strength level, weakest first
+  std::vector<SearchEngine::Limits> engineLevels_;
+  // Reviews get their own threads so they neither wait behind bot moves
+  // nor delay them
+  std::unique_ptr<EnginePool> reviewPool_;
+  uint64_t reviewNodes_{ 200'000 };
+  // Pool requests of reviews, kept apart from sessions' own requests so
+  // a session going away does not cancel a review in flight
+  static constexpr int s_ReviewID = -1;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<size_t> nextShard_{ 0 };
+  // Disabled without a persistence_dir
+  std::unique_ptr<SessionJournal> journal_;
+  std::chrono::seconds snapshotInterval_{ 300 };
+  trantor::TimerId snapshotTimer_{ trantor::InvalidTimerId };
+  std::atomic<bool> snapshotRunning_{ false };
 };
 } // namespace kamisado
@@ -0,0 +1,129 @@
+#include "BinaryProtocol.h"
+#include "kamisado/Config.hpp"
+
+namespace kamisado::binary {
+
+auto encodeSquare(Coord c) -> uint8_t {
+  return static_cast<uint8_t>((c.row * config::BoardSize) + c.col);
+}
+
+auto decodeSquare(uint8_t square) -> std::optional<Coord> {
+  if (square >= config::BoardSize * config::BoardSize) {
+    return std::nullopt;
+  }
+  return Coord{ square / config::BoardSize, square % config::BoardSize };
+}
+
+auto decodeMove(uint16_t bits) -> std::optional<Move> {
+  if (bits >> 13U != 0) {
+    return std::nullopt;
+  }
+  // 6-bit squares are always on the board
+  return Move::decode(bits);
+}
+
+auto encodeCell(Color square, std::optional<Tower> tower) -> uint8_t {
+  auto cell = static_cast<unsigned>(square);
+  if (tower) {
+    cell |= 1U << 3U;
+    cell |= static_cast<unsigned>(tower->owner) << 4U;
+    cell |= static_cast<unsigned>(tower->color) << 5U;
+  }
+  return static_cast<uint8_t>(cell);
+}
+
+auto encodeBoard(const Board& board) -> std::array<uint8_t, 64> {
+  std::array<uint8_t, 64> cells{};
+  for (size_t r = 0; r < config::BoardSize; r++) {
+    for (size_t c = 0; c < config::BoardSize; c++) {
+      Coord pos{ r, c };
+      cells[encodeSquare(pos)] =
+          encodeCell(board.coloring().at(pos), board.towerAt(pos));
+    }
+  }
+  return cells;
+}
+
+auto encodeOutcome(const Outcome& outcome) -> uint8_t {
+  if (!outcome.terminal) {
+    return 0;
+  }
+  return static_cast<uint8_t>(1 + static_cast<unsigned>(*outcome.winner));
+}
+
+auto encodeColor(std::optional<Color> color) -> uint8_t {
+  return color ? static_cast<uint8_t>(*color) : s_None;
+}
+
+Writer::Writer(std::string& out)
+    : out_{ out } {
+}
+
+void Writer::u8(uint8_t value) {
+  out_.push_back(static_cast<char>(value));
+}
+
+void Writer::u16(uint16_t value) {
+  u8(static_cast<uint8_t>(value));
+  u8(static_cast<uint8_t>(value >> 8U));
+}
+
+void Writer::u32(uint32_t value) {
+  u16(static_cast<uint16_t>(value));
+  u16(static_cast<uint16_t>(value >> 16U));
+}
+
+void Writer::i32(int32_t value) {
+  u32(static_cast<uint32_t>(value));
+}
+
+void Writer::u64(uint64_t value) {
+  u32(static_cast<uint32_t>(value));
+  u32(static_cast<uint32_t>(value >> 32U));
+}
+
+void Writer::bytes(std::string_view value) {
+  out_.append(value);
+}
+
+Reader::Reader(std::string_view in)
+    : in_{ in } {
+}
+
+auto Reader::bytes(size_t n) -> std::string_view {
+  if (in_.size() < n) {
+    throw ProtocolError("Truncated frame");
+  }
+  auto out = in_.substr(0, n);
+  in_.remove_prefix(n);
+  return out;
+}
+
+auto Reader::u8() -> uint8_t {
+  return static_cast<uint8_t>(bytes(1)[0]);
+}
+
+auto Reader::u16() -> uint16_t {
+  auto lo = u8();
+  return static_cast<uint16_t>(lo | (u8() << 8U));
+}
+
+auto Reader::u32() -> uint32_t {
+  uint32_t lo = u16();
+  return lo | (static_cast<uint32_t>(u16()) << 16U);
+}
+
+auto Reader::i32() -> int32_t {
+  return static_cast<int32_t>(u32());
+}
+
+auto Reader::u64() -> uint64_t {
+  uint64_t lo = u32();
+  return lo | (static_cast<uint64_t>(u32()) << 32U);
+}
+
+auto Reader::done() const -> bool {
+  return in_.empty();
+}
+
+} // namespace kamisado::binary
@@ -0,0 +1,99 @@
+#pragma once
+#include "kamisado/Board.hpp"
+#include "kamisado/BoardProps.hpp"
+#include "kamisado/Move.hpp"
+#include "kamisado/Outcome.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/// Compact websocket frames, chosen with ?proto=binary on connect.
+/// Integers are little endian. A frame starts with its FrameType byte:
+///
+///   State    u32 seq, u8 turn, u8 terminal, u8 forced, 64 cells,
+///            u8 n, n legal moves, u16 m, m played moves
+///   Delta    u32 seq, u16 move, u8 tower cell, u8 turn, u8 terminal,
+///            u8 forced, u8 n, n legal moves
+///   Analysis u16 best move, i32 score for white
+///   Ready    empty
+///   Terminal u8 terminal, u8 player who resigned
+///   Error    utf-8 message
+///
+/// Clients send commands the same way, each starting with its
+/// CommandType byte: Move carries a u16 move, Resign, State and Leave
+/// are empty. Errors are only sent to the client that caused them
+///
+/// Squares are row * 8 + col, moves are Move::encode(). A cell byte
+/// holds the square colour in bits 0-2, occupancy in bit 3, the owner
+/// in bit 4 and the tower colour in bits 5-7. Players are 0 for white
+/// and 1 for black, terminal is 0 ongoing or 1 + winner, a missing
+/// forced colour is s_None
+namespace kamisado::binary {
+
+enum class FrameType : uint8_t {
+  State    = 1,
+  Delta    = 2,
+  Analysis = 3,
+  Ready    = 4,
+  Terminal = 5,
+  Error    = 6,
+};
+
+enum class CommandType : uint8_t {
+  Move   = 1,
+  Resign = 2,
+  State  = 3,
+  Leave  = 4,
+};
+
+constexpr uint8_t s_None{ 0xFF };
+
+struct ProtocolError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+auto encodeSquare(Coord c) -> uint8_t;
+auto decodeSquare(uint8_t square) -> std::optional<Coord>;
+/// Validates the squares, unlike Move::decode
+auto decodeMove(uint16_t bits) -> std::optional<Move>;
+auto encodeCell(Color square, std::optional<Tower> tower) -> uint8_t;
+auto encodeBoard(const Board& board) -> std::array<uint8_t, 64>;
+auto encodeOutcome(const Outcome& outcome) -> uint8_t;
+auto encodeColor(std::optional<Color> color) -> uint8_t;
+
+class Writer {
+public:
+  explicit Writer(std::string& out);
+
+  void u8(uint8_t value);
+  void u16(uint16_t value);
+  void u32(uint32_t value);
+  void i32(int32_t value);
+  void u64(uint64_t value);
+  void bytes(std::string_view value);
+
+private:
+  std::string& out_;
+};
+
+/// Throws ProtocolError when reading past the end of the frame
+class Reader {
+public:
+  explicit Reader(std::string_view in);
+
+  auto u8() -> uint8_t;
+  auto u16() -> uint16_t;
+  auto u32() -> uint32_t;
+  auto i32() -> int32_t;
+  auto u64() -> uint64_t;
+  auto bytes(size_t n) -> std::string_view;
+  [[nodiscard]] auto done() const -> bool;
+
+private:
+  std::string_view in_;
+};
+
+} // namespace kamisado::binary
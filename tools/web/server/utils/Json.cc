@@ -1,4 +1,5 @@
 #include "Json.h"
+#include "JsonWriter.h"
 #include "Utils.h"
 
 namespace kamisado {
@@ -30,27 +31,7 @@ auto toJson(const Outcome& outcome) -> Json::Value {
 }
 
 auto toJson(Color color) -> Json::Value {
-  switch (color) {
-  case Color::Brown:
-    return "brown";
-  case Color::Green:
-    return "green";
-  case Color::Red:
-    return "red";
-  case Color::Yellow:
-    return "yellow";
-  case Color::Pink:
-    return "pink";
-  case Color::Purple:
-    return "purple";
-  case Color::Blue:
-    return "blue";
-  case Color::Orange:
-    return "orange";
-  default:
-    assert(false && "Unknown color");
-    return { Json::nullValue };
-  }
+  return std::string{ colorName(color) };
 }
 
 auto toJson(const Tower& tower) -> Json::Value {
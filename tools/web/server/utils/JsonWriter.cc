@@ -0,0 +1,223 @@
+#include "JsonWriter.h"
+#include "kamisado/Config.hpp"
+#include <array>
+#include <cassert>
+#include <charconv>
+
+namespace kamisado {
+
+namespace {
+
+constexpr size_t s_Squares = config::BoardSize * config::BoardSize;
+
+// Rows start from the top, ranks from the bottom
+constexpr auto s_SquareNames = [] {
+  std::array<std::array<char, 2>, s_Squares> names{};
+  for (size_t i = 0; i < s_Squares; i++) {
+    names[i] = { static_cast<char>('a' + (i % config::BoardSize)),
+                 static_cast<char>('0' + config::BoardSize -
+                                   (i / config::BoardSize)) };
+  }
+  return names;
+}();
+
+constexpr std::array<std::string_view, static_cast<size_t>(Color::Count)>
+    s_ColorNames{
+  "brown", "green", "red", "yellow", "pink", "purple", "blue", "orange",
+};
+
+constexpr std::array<char, 16> s_Hex{ '0', '1', '2', '3', '4', '5',
+                                      '6', '7', '8', '9', 'a', 'b',
+                                      'c', 'd', 'e', 'f' };
+
+} // namespace
+
+JsonWriter::JsonWriter(std::string& buffer)
+    : out_{ buffer } {
+  out_.clear();
+}
+
+void JsonWriter::separate() {
+  if (needComma_) {
+    out_.push_back(',');
+  }
+  needComma_ = true;
+}
+
+auto JsonWriter::beginObject() -> JsonWriter& {
+  separate();
+  out_.push_back('{');
+  needComma_ = false;
+  return *this;
+}
+
+auto JsonWriter::endObject() -> JsonWriter& {
+  out_.push_back('}');
+  needComma_ = true;
+  return *this;
+}
+
+auto JsonWriter::beginArray() -> JsonWriter& {
+  separate();
+  out_.push_back('[');
+  needComma_ = false;
+  return *this;
+}
+
+auto JsonWriter::endArray() -> JsonWriter& {
+  out_.push_back(']');
+  needComma_ = true;
+  return *this;
+}
+
+auto JsonWriter::key(std::string_view name) -> JsonWriter& {
+  separate();
+  quoted(name);
+  out_.push_back(':');
+  needComma_ = false;
+  return *this;
+}
+
+void JsonWriter::quoted(std::string_view value) {
+  out_.push_back('"');
+  for (char ch : value) {
+    auto u = static_cast<unsigned char>(ch);
+    if (ch == '"' || ch == '\\') {
+      out_.push_back('\\');
+      out_.push_back(ch);
+    } else if (u < 0x20) {
+      out_.append("\\u00");
+      out_.push_back(s_Hex[u >> 4U]);
+      out_.push_back(s_Hex[u & 0xFU]);
+    } else {
+      out_.push_back(ch);
+    }
+  }
+  out_.push_back('"');
+}
+
+auto JsonWriter::string(std::string_view value) -> JsonWriter& {
+  separate();
+  quoted(value);
+  return *this;
+}
+
+auto JsonWriter::number(int64_t value) -> JsonWriter& {
+  separate();
+  std::array<char, 24> buf{};
+  auto [end, ec] = std::to_chars(buf.begin(), buf.end(), value);
+  out_.append(buf.data(), end);
+  return *this;
+}
+
+auto JsonWriter::number(uint64_t value) -> JsonWriter& {
+  separate();
+  std::array<char, 24> buf{};
+  auto [end, ec] = std::to_chars(buf.begin(), buf.end(), value);
+  out_.append(buf.data(), end);
+  return *this;
+}
+
+auto JsonWriter::number(double value) -> JsonWriter& {
+  separate();
+  std::array<char, 32> buf{};
+  // Shortest round-trip form, callers never pass NaN or infinities
+  auto [end, ec] = std::to_chars(buf.begin(), buf.end(), value);
+  out_.append(buf.data(), end);
+  return *this;
+}
+
+auto JsonWriter::boolean(bool value) -> JsonWriter& {
+  separate();
+  out_.append(value ? "true" : "false");
+  return *this;
+}
+
+auto JsonWriter::null() -> JsonWriter& {
+  separate();
+  out_.append("null");
+  return *this;
+}
+
+auto JsonWriter::raw(std::string_view json) -> JsonWriter& {
+  separate();
+  out_.append(json);
+  return *this;
+}
+
+auto JsonWriter::str() const -> std::string_view {
+  return out_;
+}
+
+auto squareName(Coord c) -> std::string_view {
+  const auto& name = s_SquareNames[(c.row * config::BoardSize) + c.col];
+  return { name.data(), name.size() };
+}
+
+auto colorName(Color color) -> std::string_view {
+  auto index = static_cast<size_t>(color);
+  assert(index < s_ColorNames.size() && "Unknown color");
+  return s_ColorNames[index];
+}
+
+auto playerName(Player player) -> std::string_view {
+  return player == Player::White ? "white" : "black";
+}
+
+void write(JsonWriter& out, Coord c) {
+  out.string(squareName(c));
+}
+
+void write(JsonWriter& out, Player player) {
+  out.string(playerName(player));
+}
+
+void write(JsonWriter& out, Color color) {
+  out.string(colorName(color));
+}
+
+void write(JsonWriter& out, const Move& move) {
+  out.beginObject();
+  out.key("from").string(squareName(move.from));
+  out.key("to").string(squareName(move.to));
+  out.endObject();
+}
+
+void write(JsonWriter& out, const Outcome& outcome) {
+  out.beginObject();
+  if (outcome.terminal) {
+    out.key("status").string("win");
+    out.key("winner").string(playerName(*outcome.winner));
+  } else {
+    out.key("status").string("ongoing");
+  }
+  out.endObject();
+}
+
+void write(JsonWriter& out, const Tower& tower) {
+  out.beginObject();
+  out.key("side").string(playerName(tower.owner));
+  out.key("color").string(colorName(tower.color));
+  out.endObject();
+}
+
+void write(JsonWriter& out, const Board& board) {
+  out.beginArray();
+  for (size_t r = 0; r < config::BoardSize; r++) {
+    out.beginArray();
+    for (size_t c = 0; c < config::BoardSize; c++) {
+      Coord pos{ r, c };
+      out.beginObject();
+      out.key("color").string(colorName(board.coloring().at(pos)));
+      if (auto tower = board.towerAt(pos)) {
+        out.key("piece");
+        write(out, *tower);
+      }
+      out.endObject();
+    }
+    out.endArray();
+  }
+  out.endArray();
+}
+
+} // namespace kamisado
@@ -0,0 +1,61 @@
+#pragma once
+#include "kamisado/Board.hpp"
+#include "kamisado/BoardProps.hpp"
+#include "kamisado/Move.hpp"
+#include "kamisado/Outcome.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace kamisado {
+
+/// Streams JSON into a caller-owned buffer, for the fixed-shape
+/// messages sent on every move. The buffer is cleared but keeps its
+/// capacity, so a reused buffer stops allocating once warm. Commas are
+/// inserted automatically, nesting is up to the caller
+class JsonWriter {
+public:
+  explicit JsonWriter(std::string& buffer);
+
+  auto beginObject() -> JsonWriter&;
+  auto endObject() -> JsonWriter&;
+  auto beginArray() -> JsonWriter&;
+  auto endArray() -> JsonWriter&;
+  auto key(std::string_view name) -> JsonWriter&;
+
+  auto string(std::string_view value) -> JsonWriter&;
+  auto number(int64_t value) -> JsonWriter&;
+  auto number(uint64_t value) -> JsonWriter&;
+  auto number(double value) -> JsonWriter&;
+  auto boolean(bool value) -> JsonWriter&;
+  auto null() -> JsonWriter&;
+  /// Appends an already serialised value as is
+  auto raw(std::string_view json) -> JsonWriter&;
+
+  auto str() const -> std::string_view;
+
+private:
+  void separate();
+  // Appends an already escaped, quoted string
+  void quoted(std::string_view value);
+
+private:
+  std::string& out_;
+  bool needComma_{ false };
+};
+
+/// File and rank, e.g. "a8", from a precomputed table
+auto squareName(Coord c) -> std::string_view;
+auto colorName(Color color) -> std::string_view;
+auto playerName(Player player) -> std::string_view;
+
+// Same shapes as the toJson overloads in Json.h
+void write(JsonWriter& out, Coord c);
+void write(JsonWriter& out, Player player);
+void write(JsonWriter& out, Color color);
+void write(JsonWriter& out, const Move& move);
+void write(JsonWriter& out, const Outcome& outcome);
+void write(JsonWriter& out, const Tower& tower);
+void write(JsonWriter& out, const Board& board);
+
+} // namespace kamisado
@@ -0,0 +1,215 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace kamisado::metrics {
+
+namespace {
+
+constexpr auto s_Histograms = static_cast<size_t>(Histogram::Count);
+constexpr auto s_Counters   = static_cast<size_t>(Counter::Count);
+constexpr auto s_Gauges     = static_cast<size_t>(Gauge::Count);
+
+// Upper bucket bounds, an implicit +Inf bucket follows
+constexpr std::array<std::chrono::nanoseconds, 14> s_Buckets{
+  std::chrono::microseconds{ 10 },  std::chrono::microseconds{ 25 },
+  std::chrono::microseconds{ 50 },  std::chrono::microseconds{ 100 },
+  std::chrono::microseconds{ 250 }, std::chrono::microseconds{ 500 },
+  std::chrono::milliseconds{ 1 },   std::chrono::microseconds{ 2500 },
+  std::chrono::milliseconds{ 5 },   std::chrono::milliseconds{ 10 },
+  std::chrono::milliseconds{ 25 },  std::chrono::milliseconds{ 50 },
+  std::chrono::milliseconds{ 100 }, std::chrono::milliseconds{ 250 },
+};
+
+struct Description {
+  std::string_view name;
+  std::string_view help;
+};
+
+constexpr std::array<Description, s_Histograms> s_HistogramNames{ {
+    { "kamisado_move_latency_seconds",
+      "Time from receiving a move over HTTP or websocket to applying "
+      "it" },
+    { "kamisado_state_serialize_seconds",
+      "Time spent serialising session snapshots" },
+    { "kamisado_fanout_seconds",
+      "Time spent sending one message to all subscribers" },
+} };
+
+constexpr std::array<Description, s_Counters> s_CounterNames{ {
+    { "kamisado_engine_nodes_total", "Nodes searched by all engines" },
+    { "kamisado_engine_table_probes_total",
+      "Transposition table lookups by all engines" },
+    { "kamisado_engine_table_hits_total",
+      "Transposition table lookups that found an entry" },
+} };
+
+constexpr std::array<Description, s_Gauges> s_GaugeNames{ {
+    { "kamisado_sessions", "Live sessions" },
+    { "kamisado_subscribers", "Websocket subscribers of all sessions" },
+    { "kamisado_running_searches",
+      "Analysis slices and engine moves being searched" },
+} };
+
+struct HistogramSlots {
+  std::array<std::atomic<uint64_t>, s_Buckets.size() + 1> buckets{};
+  std::atomic<uint64_t> sumNs{ 0 };
+};
+
+struct ThreadSlots {
+  std::array<HistogramSlots, s_Histograms> histograms{};
+  std::array<std::atomic<uint64_t>, s_Counters> counters{};
+  std::array<std::atomic<int64_t>, s_Gauges> gauges{};
+};
+
+// Only the owning thread writes its slots, so a relaxed load and store
+// replaces a locked read-modify-write
+template <typename T>
+void bump(std::atomic<T>& slot, T value) {
+  slot.store(slot.load(std::memory_order_relaxed) + value,
+             std::memory_order_relaxed);
+}
+
+template <typename T>
+auto read(const std::atomic<T>& slot) -> T {
+  return slot.load(std::memory_order_relaxed);
+}
+
+struct Registry {
+  // Taken once per thread and once per scrape
+  std::mutex mutex;
+  // Never freed, so totals survive their threads
+  std::vector<std::unique_ptr<ThreadSlots>> threads;
+};
+
+auto registry() -> Registry& {
+  static Registry registry;
+  return registry;
+}
+
+auto slots() -> ThreadSlots& {
+  thread_local ThreadSlots* local = [] {
+    auto& reg = registry();
+    std::scoped_lock lock{ reg.mutex };
+    reg.threads.push_back(std::make_unique<ThreadSlots>());
+    return reg.threads.back().get();
+  }();
+  return *local;
+}
+
+template <typename Duration>
+auto seconds(Duration duration) -> double {
+  return std::chrono::duration<double>(duration).count();
+}
+
+} // namespace
+
+void observe(Histogram histogram, std::chrono::nanoseconds duration) {
+  auto& slot = slots().histograms[static_cast<size_t>(histogram)];
+  auto bucket =
+      std::ranges::lower_bound(s_Buckets, duration) - s_Buckets.begin();
+  bump(slot.buckets[bucket], uint64_t{ 1 });
+  bump(slot.sumNs, static_cast<uint64_t>(duration.count()));
+}
+
+void add(Counter counter, uint64_t value) {
+  bump(slots().counters[static_cast<size_t>(counter)], value);
+}
+
+void add(Gauge gauge, int64_t delta) {
+  bump(slots().gauges[static_cast<size_t>(gauge)], delta);
+}
+
+void recordSearch(uint64_t nodes, uint64_t tableProbes,
+                  uint64_t tableHits) {
+  add(Counter::EngineNodes, nodes);
+  add(Counter::TableProbes, tableProbes);
+  add(Counter::TableHits, tableHits);
+}
+
+auto render() -> std::string {
+  std::array<std::array<uint64_t, s_Buckets.size() + 1>, s_Histograms>
+      buckets{};
+  std::array<uint64_t, s_Histograms> sums{};
+  std::array<uint64_t, s_Counters> counters{};
+  std::array<int64_t, s_Gauges> gauges{};
+
+  auto& reg = registry();
+  std::scoped_lock lock{ reg.mutex };
+  for (const auto& thread : reg.threads) {
+    for (size_t h = 0; h < s_Histograms; h++) {
+      const auto& slot = thread->histograms[h];
+      for (size_t b = 0; b < slot.buckets.size(); b++) {
+        buckets[h][b] += read(slot.buckets[b]);
+      }
+      sums[h] += read(slot.sumNs);
+    }
+    for (size_t c = 0; c < s_Counters; c++) {
+      counters[c] += read(thread->counters[c]);
+    }
+    for (size_t g = 0; g < s_Gauges; g++) {
+      gauges[g] += read(thread->gauges[g]);
+    }
+  }
+
+  std::string out;
+  auto sink   = std::back_inserter(out);
+  auto header = [&](const Description& desc, std::string_view type) {
+    fmt::format_to(sink, "# HELP {} {}\n# TYPE {} {}\n", desc.name,
+                   desc.help, desc.name, type);
+  };
+
+  for (size_t h = 0; h < s_Histograms; h++) {
+    const auto& desc = s_HistogramNames[h];
+    header(desc, "histogram");
+    uint64_t count{ 0 };
+    for (size_t b = 0; b < buckets[h].size(); b++) {
+      count += buckets[h][b];
+      if (b < s_Buckets.size()) {
+        fmt::format_to(sink, "{}_bucket{{le=\"{}\"}} {}\n", desc.name,
+                       seconds(s_Buckets[b]), count);
+      } else {
+        fmt::format_to(sink, "{}_bucket{{le=\"+Inf\"}} {}\n", desc.name,
+                       count);
+      }
+    }
+    fmt::format_to(sink, "{}_sum {}\n{}_count {}\n", desc.name,
+                   seconds(std::chrono::nanoseconds(sums[h])), desc.name,
+                   count);
+  }
+
+  for (size_t c = 0; c < s_Counters; c++) {
+    header(s_CounterNames[c], "counter");
+    fmt::format_to(sink, "{} {}\n", s_CounterNames[c].name, counters[c]);
+  }
+
+  for (size_t g = 0; g < s_Gauges; g++) {
+    header(s_GaugeNames[g], "gauge");
+    fmt::format_to(sink, "{} {}\n", s_GaugeNames[g].name, gauges[g]);
+  }
+
+  auto probes = counters[static_cast<size_t>(Counter::TableProbes)];
+  auto hits   = counters[static_cast<size_t>(Counter::TableHits)];
+  header({ "kamisado_engine_table_hit_ratio",
+           "Share of transposition table lookups that hit" },
+         "gauge");
+  fmt::format_to(sink, "kamisado_engine_table_hit_ratio {}\n",
+                 probes > 0 ? static_cast<double>(hits) /
+                                  static_cast<double>(probes)
+                            : 0.0);
+  return out;
+}
+
+Timer::Timer(Histogram histogram)
+    : histogram_{ histogram },
+      start_{ std::chrono::steady_clock::now() } {}
+
+Timer::~Timer() {
+  observe(histogram_, std::chrono::steady_clock::now() - start_);
+}
+
+} // namespace kamisado::metrics
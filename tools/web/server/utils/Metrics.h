@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/// Process-wide server metrics in the Prometheus text format, see
+/// MetricsController. Every thread records into its own slots with
+/// relaxed atomics and no locks; render() sums the slots of all threads
+/// that ever recorded, so values survive their threads
+namespace kamisado::metrics {
+
+enum class Histogram : uint8_t {
+  /// Move handler or websocket command entry to the applied move,
+  /// including the loop hop. Search speed is rate() over EngineNodes
+  MoveLatency,
+  /// Serialising a session snapshot
+  StateSerialize,
+  /// Sending one message to all subscribers of a session
+  FanOut,
+  Count
+};
+
+enum class Counter : uint8_t {
+  EngineNodes,
+  TableProbes,
+  TableHits,
+  Count
+};
+
+/// Levels kept as per-thread deltas, a thread may go negative
+enum class Gauge : uint8_t {
+  Sessions,
+  Subscribers,
+  RunningSearches,
+  Count
+};
+
+void observe(Histogram histogram, std::chrono::nanoseconds duration);
+void add(Counter counter, uint64_t value);
+void add(Gauge gauge, int64_t delta);
+
+/// Totals after a search, shared by the analysis and engine pools
+void recordSearch(uint64_t nodes, uint64_t tableProbes,
+                  uint64_t tableHits);
+
+auto render() -> std::string;
+
+/// Observes the time until it goes out of scope
+class Timer {
+public:
+  explicit Timer(Histogram histogram);
+  ~Timer();
+
+  Timer(const Timer&)                    = delete;
+  auto operator=(const Timer&) -> Timer& = delete;
+
+private:
+  Histogram histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace kamisado::metrics
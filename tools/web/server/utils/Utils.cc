@@ -36,8 +36,24 @@ auto parseToken(const drogon::HttpRequestPtr& req) -> Token {
 
 namespace {
 constexpr std::string_view files = "abcdefgh";
+
+// NOLINTNEXTLINE
+const std::string identityAttribute = "kamisado.identity";
 } // namespace
 
+void setAuthIdentity(const drogon::HttpRequestPtr& req,
+                     Identity identity) {
+  req->attributes()->insert(identityAttribute, identity);
+}
+
+auto authIdentity(const drogon::HttpRequestPtr& req)
+    -> std::optional<Identity> {
+  if (!req->attributes()->find(identityAttribute)) {
+    return std::nullopt;
+  }
+  return req->attributes()->get<Identity>(identityAttribute);
+}
+
 /// Coords are 0-indexed, rows start from top, while ranks start from
 /// bottom
 auto coordToFileRank(Coord c) -> std::string {
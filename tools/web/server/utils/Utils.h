@@ -11,6 +11,15 @@ void sendJsonError(
 
 auto parseToken(const drogon::HttpRequestPtr& req) -> Token;
 
+using Identity = std::pair<int, Player>;
+
+/// Stored by AuthFilter, so handlers behind it never hash the token again
+void setAuthIdentity(const drogon::HttpRequestPtr& req, Identity identity);
+
+/// Session and side resolved by AuthFilter, empty on unfiltered routes
+auto authIdentity(const drogon::HttpRequestPtr& req)
+    -> std::optional<Identity>;
+
 auto coordToFileRank(Coord c) -> std::string;
 
 auto fileRankToCoord(const std::string& fileRank) -> std::optional<Coord>;